@@ -0,0 +1,236 @@
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/hash.h>
+#include <mruby/string.h>
+#include <mruby/compile.h>
+#include <mruby/num_helpers.h>
+#include <mruby/cpp_to_mrb_value.hpp>
+#include <mruby/mrb_value_to_cpp.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <set>
+#include <unordered_set>
+
+// Emits one JSON object per line:
+// {"name":...,"size":...,"iterations":...,"ns_per_op":...,"allocs_per_op":...,"gc_runs":...}
+
+struct alloc_stats {
+  uint64_t allocs = 0;
+  uint64_t frees = 0;
+};
+
+static void*
+counting_allocf(mrb_state* mrb, void* p, size_t size, void* ud)
+{
+  alloc_stats* stats = static_cast<alloc_stats*>(ud);
+  if (size == 0) {
+    if (p) ++stats->frees;
+    free(p);
+    return nullptr;
+  }
+  ++stats->allocs;
+  return realloc(p, size);
+}
+
+static const size_t bench_sizes[] = {1, 16, 256, 4096, 65536};
+static const auto bench_budget = std::chrono::milliseconds(200);
+
+template <typename F>
+static void
+run_bench(mrb_state* mrb, alloc_stats& stats, const char* name, size_t size, F&& fn)
+{
+  using clock = std::chrono::steady_clock;
+  int ai = mrb_gc_arena_save(mrb);
+
+  // warm up caches and let the GC settle before measuring
+  for (int i = 0; i < 3; ++i) {
+    fn();
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  mrb_full_gc(mrb);
+
+  uint64_t iterations = 0;
+  uint64_t gc_runs = 0;
+  int gc_state = mrb->gc.state;
+  uint64_t allocs_before = stats.allocs;
+  auto start = clock::now();
+  auto elapsed = clock::duration::zero();
+  do {
+    fn();
+    mrb_gc_arena_restore(mrb, ai);
+    ++iterations;
+    if (mrb->gc.state != gc_state) {
+      if (mrb->gc.state == MRB_GC_STATE_ROOT) ++gc_runs;
+      gc_state = mrb->gc.state;
+    }
+    if ((iterations & 15) == 0) elapsed = clock::now() - start;
+  } while (elapsed < bench_budget);
+  elapsed = clock::now() - start;
+
+  if (mrb->exc) {
+    mrb_print_error(mrb);
+    exit(EXIT_FAILURE);
+  }
+
+  double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+  printf("{\"name\":\"%s\",\"size\":%zu,\"iterations\":%llu,\"ns_per_op\":%.2f,\"allocs_per_op\":%.2f,\"gc_runs\":%llu}\n",
+    name, size, (unsigned long long) iterations, ns / iterations,
+    (double) (stats.allocs - allocs_before) / iterations,
+    (unsigned long long) gc_runs);
+  fflush(stdout);
+}
+
+static void
+bench_cpp_to_mrb_value(mrb_state* mrb, alloc_stats& stats)
+{
+  for (size_t n : bench_sizes) {
+    std::vector<int32_t> ints(n);
+    std::vector<double> doubles(n);
+    std::vector<std::string> strings(n);
+    std::map<std::string, int64_t> smap;
+    std::unordered_map<std::string, int64_t> umap;
+    std::set<int64_t> sset;
+    std::unordered_set<std::string> uset;
+    std::vector<std::chrono::system_clock::time_point> times(n, std::chrono::system_clock::now());
+    for (size_t i = 0; i < n; ++i) {
+      ints[i] = static_cast<int32_t>(i);
+      doubles[i] = i * 0.5;
+      strings[i] = "key" + std::to_string(i);
+      smap.emplace(strings[i], i);
+      umap.emplace(strings[i], i);
+      sset.insert(i);
+      uset.insert(strings[i]);
+    }
+
+    run_bench(mrb, stats, "cpp_to_mrb_value/vector<int32_t>", n, [&] { cpp_to_mrb_value(mrb, ints); });
+    run_bench(mrb, stats, "cpp_to_mrb_value/vector<double>", n, [&] { cpp_to_mrb_value(mrb, doubles); });
+    run_bench(mrb, stats, "cpp_to_mrb_value/vector<string>", n, [&] { cpp_to_mrb_value(mrb, strings); });
+    run_bench(mrb, stats, "cpp_to_mrb_value/map<string,int64_t>", n, [&] { cpp_to_mrb_value(mrb, smap); });
+    run_bench(mrb, stats, "cpp_to_mrb_value/unordered_map<string,int64_t>", n, [&] { cpp_to_mrb_value(mrb, umap); });
+    run_bench(mrb, stats, "cpp_to_mrb_value/set<int64_t>", n, [&] { cpp_to_mrb_value(mrb, sset); });
+    run_bench(mrb, stats, "cpp_to_mrb_value/unordered_set<string>", n, [&] { cpp_to_mrb_value(mrb, uset); });
+    run_bench(mrb, stats, "cpp_to_mrb_value/vector<time_point>", n, [&] { cpp_to_mrb_value(mrb, times); });
+  }
+}
+
+static mrb_value
+load_fixture(mrb_state* mrb, const char* code, size_t n)
+{
+  char buf[256];
+  snprintf(buf, sizeof(buf), code, n);
+  mrb_value v = mrb_load_string(mrb, buf);
+  if (mrb->exc) {
+    mrb_print_error(mrb);
+    exit(EXIT_FAILURE);
+  }
+  mrb_gc_register(mrb, v);
+  return v;
+}
+
+static void
+bench_mrb_value_to_cpp(mrb_state* mrb, alloc_stats& stats)
+{
+  for (size_t n : bench_sizes) {
+    int ai = mrb_gc_arena_save(mrb);
+    mrb_value ints = load_fixture(mrb, "Array.new(%zu) { |i| i }", n);
+    mrb_value floats = load_fixture(mrb, "Array.new(%zu) { |i| i * 0.5 }", n);
+    mrb_value strings = load_fixture(mrb, "Array.new(%zu) { |i| \"key#{i}\" }", n);
+    mrb_value hash = load_fixture(mrb, "h = {}; %zu.times { |i| h[\"key#{i}\"] = i }; h", n);
+    mrb_value nested = load_fixture(mrb, "Array.new(%zu) { |i| {'id' => i, 'tags' => ['a', 'b'], 'score' => i * 0.5} }", n);
+    mrb_gc_arena_restore(mrb, ai);
+
+    run_bench(mrb, stats, "mrb_value_to_any/array<int>", n, [&] { mrb_value_to_any(mrb, ints); });
+    run_bench(mrb, stats, "mrb_value_to_any/array<float>", n, [&] { mrb_value_to_any(mrb, floats); });
+    run_bench(mrb, stats, "mrb_value_to_any/array<string>", n, [&] { mrb_value_to_any(mrb, strings); });
+    run_bench(mrb, stats, "mrb_value_to_any/array<hash>", n, [&] { mrb_value_to_any(mrb, nested); });
+    run_bench(mrb, stats, "mrb_hash_to_map/hash<string,int>", n, [&] { mrb_hash_to_map(mrb, hash); });
+
+    mrb_gc_unregister(mrb, ints);
+    mrb_gc_unregister(mrb, floats);
+    mrb_gc_unregister(mrb, strings);
+    mrb_gc_unregister(mrb, hash);
+    mrb_gc_unregister(mrb, nested);
+  }
+}
+
+static void
+bench_codecs(mrb_state* mrb, alloc_stats& stats)
+{
+  const mrb_int i = 0x0102030405060708LL & MRB_INT_MAX;
+  mrb_value fix_nat = MRB_ENCODE_FIX_NAT(mrb, i);
+  mrb_gc_register(mrb, fix_nat);
+  mrb_value fix_le = MRB_ENCODE_FIX_LE(mrb, i);
+  mrb_gc_register(mrb, fix_le);
+  mrb_value fix_be = MRB_ENCODE_FIX_BE(mrb, i);
+  mrb_gc_register(mrb, fix_be);
+
+  run_bench(mrb, stats, "MRB_ENCODE_FIX_NAT", 1, [&] { MRB_ENCODE_FIX_NAT(mrb, i); });
+  run_bench(mrb, stats, "MRB_DECODE_FIX_NAT", 1, [&] { MRB_DECODE_FIX_NAT(mrb, fix_nat); });
+  run_bench(mrb, stats, "MRB_ENCODE_FIX_LE", 1, [&] { MRB_ENCODE_FIX_LE(mrb, i); });
+  run_bench(mrb, stats, "MRB_DECODE_FIX_LE", 1, [&] { MRB_DECODE_FIX_LE(mrb, fix_le); });
+  run_bench(mrb, stats, "MRB_ENCODE_FIX_BE", 1, [&] { MRB_ENCODE_FIX_BE(mrb, i); });
+  run_bench(mrb, stats, "MRB_DECODE_FIX_BE", 1, [&] { MRB_DECODE_FIX_BE(mrb, fix_be); });
+
+#ifndef MRB_NO_FLOAT
+  const mrb_float f = 3.14159;
+  mrb_value flo_nat = MRB_ENCODE_FLO_NAT(mrb, f);
+  mrb_gc_register(mrb, flo_nat);
+  mrb_value flo_le = MRB_ENCODE_FLO_LE(mrb, f);
+  mrb_gc_register(mrb, flo_le);
+  mrb_value flo_be = MRB_ENCODE_FLO_BE(mrb, f);
+  mrb_gc_register(mrb, flo_be);
+
+  run_bench(mrb, stats, "MRB_ENCODE_FLO_NAT", 1, [&] { MRB_ENCODE_FLO_NAT(mrb, f); });
+  run_bench(mrb, stats, "MRB_DECODE_FLO_NAT", 1, [&] { MRB_DECODE_FLO_NAT(mrb, flo_nat); });
+  run_bench(mrb, stats, "MRB_ENCODE_FLO_LE", 1, [&] { MRB_ENCODE_FLO_LE(mrb, f); });
+  run_bench(mrb, stats, "MRB_DECODE_FLO_LE", 1, [&] { MRB_DECODE_FLO_LE(mrb, flo_le); });
+  run_bench(mrb, stats, "MRB_ENCODE_FLO_BE", 1, [&] { MRB_ENCODE_FLO_BE(mrb, f); });
+  run_bench(mrb, stats, "MRB_DECODE_FLO_BE", 1, [&] { MRB_DECODE_FLO_BE(mrb, flo_be); });
+#endif
+}
+
+static void
+bench_ruby_methods(mrb_state* mrb, alloc_stats& stats)
+{
+  static const char* const encoders[] = {"to_bin", "to_bin_le", "to_bin_be"};
+  static const char* const decoders[] = {"to_fix", "to_fix_le", "to_fix_be"};
+
+  mrb_value num = mrb_fixnum_value(100);
+  for (size_t k = 0; k < 3; ++k) {
+    mrb_sym enc = mrb_intern_cstr(mrb, encoders[k]);
+    mrb_sym dec = mrb_intern_cstr(mrb, decoders[k]);
+    mrb_value bin = mrb_funcall_argv(mrb, num, enc, 0, nullptr);
+    mrb_gc_register(mrb, bin);
+
+    std::string enc_name = std::string("Integer#") + encoders[k];
+    std::string dec_name = std::string("String#") + decoders[k];
+    run_bench(mrb, stats, enc_name.c_str(), 1, [&] { mrb_funcall_argv(mrb, num, enc, 0, nullptr); });
+    run_bench(mrb, stats, dec_name.c_str(), 1, [&] { mrb_funcall_argv(mrb, bin, dec, 0, nullptr); });
+  }
+}
+
+int
+main(int argc, char** argv)
+{
+  alloc_stats stats;
+  mrb_state* mrb = mrb_open_allocf(counting_allocf, &stats);
+  if (!mrb) {
+    fputs("mrb_open failed\n", stderr);
+    return EXIT_FAILURE;
+  }
+
+  const char* filter = argc > 1 ? argv[1] : nullptr;
+  if (!filter || strstr("cpp_to_mrb_value", filter)) bench_cpp_to_mrb_value(mrb, stats);
+  if (!filter || strstr("mrb_value_to_cpp", filter)) bench_mrb_value_to_cpp(mrb, stats);
+  if (!filter || strstr("codecs", filter)) bench_codecs(mrb, stats);
+  if (!filter || strstr("methods", filter)) bench_ruby_methods(mrb, stats);
+
+  mrb_close(mrb);
+  return EXIT_SUCCESS;
+}
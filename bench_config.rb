@@ -0,0 +1,10 @@
+MRuby::Build.new do |conf|
+  conf.toolchain
+
+  # Benchmarks need an optimized build without sanitizers or debug hooks
+  conf.cc.flags << '-O2' << '-fno-omit-frame-pointer'
+  conf.cxx.flags << '-O2' << '-fno-omit-frame-pointer'
+
+  conf.gem File.expand_path(File.dirname(__FILE__))
+  conf.gem File.expand_path('bench', File.dirname(__FILE__))
+end
@@ -32,3 +32,13 @@ MRuby::Build.new do |conf|
 
   conf.gem File.expand_path(File.dirname(__FILE__))
 end
+
+# The optional statistics compiled in, the defines have to reach every compiler of the build
+MRuby::Build.new('stats') do |conf|
+  conf.toolchain :clang
+  conf.enable_debug
+  conf.enable_test
+  conf.compilers.each { |c| c.defines << 'MRB_CPP_OBJECT_STATS' << 'MRB_CONVERSION_STATS' }
+
+  conf.gem File.expand_path(File.dirname(__FILE__))
+end
@@ -0,0 +1,129 @@
+#pragma once
+#include <mruby.h>
+#include <mruby/array.h>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <iterator>
+#include "branch_pred.h"
+#include "num_helpers.hpp"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+namespace mrbcpp::value_converter {
+  // vector<T>, array<T, N>, span<T> and friends of plain numbers, vector<bool> has no data()
+  template <typename T, typename = void>
+  struct is_contiguous_arithmetic : std::false_type {};
+
+  template <typename T>
+  struct is_contiguous_arithmetic<T, std::void_t<
+    typename T::value_type,
+    decltype(std::data(std::declval<const T&>())),
+    decltype(std::size(std::declval<const T&>()))>>
+  : std::bool_constant<
+      std::is_arithmetic_v<typename T::value_type> &&
+      !std::is_same_v<typename T::value_type, bool> &&
+      std::is_pointer_v<decltype(std::data(std::declval<const T&>()))>> {};
+
+  template <typename T>
+  constexpr bool is_contiguous_arithmetic_v = is_contiguous_arithmetic<T>::value;
+
+  // Number of leading elements which can be boxed as fixnums.
+  // 64 bit values are checked 4 (AVX2) or 2 (SSE4.2) at a time, unsigned values are
+  // checked as signed ones against [0, MRB_FIXNUM_MAX], everything above turns negative then.
+  template <typename T>
+  inline std::size_t fixable_prefix(const T* p, std::size_t n) {
+    std::size_t i = 0;
+    if constexpr (sizeof(T) == sizeof(int64_t)) {
+      constexpr int64_t min = std::is_unsigned_v<T> ? 0 : static_cast<int64_t>(MRB_FIXNUM_MIN);
+      constexpr int64_t max = static_cast<int64_t>(MRB_FIXNUM_MAX);
+#if defined(__AVX2__)
+      const __m256i lo = _mm256_set1_epi64x(min);
+      const __m256i hi = _mm256_set1_epi64x(max);
+      for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        __m256i bad = _mm256_or_si256(_mm256_cmpgt_epi64(v, hi), _mm256_cmpgt_epi64(lo, v));
+        if (!_mm256_testz_si256(bad, bad)) break;
+      }
+#elif defined(__SSE4_2__)
+      const __m128i lo = _mm_set1_epi64x(min);
+      const __m128i hi = _mm_set1_epi64x(max);
+      for (; i + 2 <= n; i += 2) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i bad = _mm_or_si128(_mm_cmpgt_epi64(v, hi), _mm_cmpgt_epi64(lo, v));
+        if (_mm_movemask_epi8(bad)) break;
+      }
+#else
+      // branch free blocks of 8, compilers vectorize this on their own
+      using U = uint64_t;
+      constexpr U range = static_cast<U>(max) - static_cast<U>(min);
+      for (; i + 8 <= n; i += 8) {
+        U bad = 0;
+        for (std::size_t j = 0; j < 8; ++j) {
+          bad |= static_cast<U>(static_cast<U>(p[i + j]) - static_cast<U>(min)) > range;
+        }
+        if (bad) break;
+      }
+#endif
+    }
+    for (; i < n; ++i) {
+      if constexpr (std::is_signed_v<T>) {
+        if (!FIXABLE(p[i])) break;
+      } else {
+        if (static_cast<uint64_t>(p[i]) > static_cast<uint64_t>(MRB_FIXNUM_MAX)) break;
+      }
+    }
+    return i;
+  }
+}
+
+// Appends n numbers to an Array in one go.
+// The Array is grown once, fixnums are boxed straight into its buffer, only values
+// outside the fixnum range go through mrb_convert_number.
+template <typename T>
+void mrb_ary_push_numbers(mrb_state* mrb, mrb_value ary, const T* data, std::size_t n) {
+  using namespace mrbcpp::number_converter;
+  static_assert(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>, "expected a number type");
+
+  mrb_int base = RARRAY_LEN(ary);
+  mrb_ary_resize(mrb, ary, base + static_cast<mrb_int>(n));
+  int arena_index = mrb_gc_arena_save(mrb);
+
+  if constexpr (std::is_integral_v<T> && type_fits_fixnum<T>()) {
+    mrb_value* ptr = RARRAY_PTR(ary) + base;
+    for (std::size_t i = 0; i < n; ++i) {
+      ptr[i] = mrb_fixnum_value(static_cast<mrb_int>(data[i]));
+    }
+  } else if constexpr (std::is_integral_v<T>) {
+    std::size_t i = 0;
+    while (i < n) {
+      std::size_t fit = mrbcpp::value_converter::fixable_prefix(data + i, n - i);
+      mrb_value* ptr = RARRAY_PTR(ary) + base + i;
+      for (std::size_t j = 0; j < fit; ++j) {
+        ptr[j] = mrb_fixnum_value(static_cast<mrb_int>(data[i + j]));
+      }
+      i += fit;
+      if (i < n) {
+        mrb_ary_set(mrb, ary, base + static_cast<mrb_int>(i), mrb_convert_number(mrb, data[i]));
+        mrb_gc_arena_restore(mrb, arena_index);
+        ++i;
+      }
+    }
+  } else {
+    for (std::size_t i = 0; i < n; ++i) {
+      mrb_ary_set(mrb, ary, base + static_cast<mrb_int>(i), mrb_convert_number(mrb, data[i]));
+      mrb_gc_arena_restore(mrb, arena_index);
+    }
+  }
+}
+
+// Converts a contiguous range of numbers into an Array in one go.
+template <typename T>
+mrb_value mrb_ary_from_numbers(mrb_state* mrb, const T* data, std::size_t n) {
+  mrb_value ary = mrb_ary_new_capa(mrb, static_cast<mrb_int>(n));
+  mrb_ary_push_numbers(mrb, ary, data, n);
+  return ary;
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include <mruby.h>
+#include <mruby/class.h>
+#include <mruby/presym.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "branch_pred.h"
+#include "cpp_object_stats.hpp"
+
+struct mrb_cpp_pool;
+struct mrb_data_type;
+
+// Struct class generated for a type described with MRB_CPP_DESCRIBE, members in declaration order
+struct mrb_described_struct {
+  struct RClass* cls = nullptr;
+  std::vector<mrb_sym> members;
+};
+
+// Conversion paths counted when MRB_CONVERSION_STATS is defined. The entry points
+// (cpp_to_mrb_value, mrb_value_to_any, encode and decode) are timed, the others are
+// the branches of mrb_converter and only count.
+// The define changes mrb_converter_timer and the inline functions below, so every
+// translation unit of a build, the gem's own included, has to agree on it.
+enum mrb_conversion_path {
+  MRB_CONV_CPP_TO_MRB,
+  MRB_CONV_SCALAR,
+  MRB_CONV_STRING,
+  MRB_CONV_ARRAY,
+  MRB_CONV_NUMBERS,
+  MRB_CONV_MAP,
+  MRB_CONV_SET,
+  MRB_CONV_STRUCT,
+  MRB_CONV_TIME,
+  MRB_CONV_TO_ANY,
+  MRB_CONV_ENCODE,
+  MRB_CONV_DECODE,
+  MRB_CONV_PATH_COUNT
+};
+
+struct mrb_conversion_counter {
+  uint64_t calls = 0;
+  uint64_t elements = 0;
+  uint64_t bytes = 0;
+  uint64_t nanoseconds = 0;
+};
+
+// Classes the converters look up, resolved on first use and kept per mrb_state.
+// The context lives as long as the mrb_state, the resolved classes are kept alive by it.
+struct mrb_converter_context {
+  struct RClass* time_class = nullptr;
+  struct RClass* set_class = nullptr;
+  struct RClass* struct_class = nullptr;
+  std::unordered_map<const void*, mrb_described_struct> described;
+  // highest GC arena index seen while converting C++ values, only tracked when MRB_DEBUG is defined
+  int arena_high_water = 0;
+  // slab pools of MRB_CPP_DEFINE_POOLED_TYPE types, see cpp_pool.hpp
+  std::unordered_map<const struct mrb_data_type*, mrb_cpp_pool*> pools;
+  bool pools_closed = false;
+  // objects created per data type, only kept when MRB_CPP_OBJECT_STATS is defined
+  std::unordered_map<const struct mrb_data_type*, mrb_cpp_object_counter> object_stats;
+  mrb_conversion_counter conversion_stats[MRB_CONV_PATH_COUNT];
+  mrb_value holder = mrb_nil_value();
+};
+
+MRB_API mrb_converter_context* mrb_converter_context_get(mrb_state* mrb);
+// Forgets the resolved Time, Set and Struct classes, call it after one of them got redefined.
+// Struct classes of described types are kept so their existing instances still convert.
+MRB_API void mrb_converter_context_invalidate(mrb_state* mrb);
+// Struct class for the described type identified by key, created on first use
+MRB_API const mrb_described_struct* mrb_converter_context_describe(mrb_state* mrb, const void* key, const char* const* names, size_t n);
+// Slow path of the accessors below, raises a NameError when the class is not defined
+MRB_API struct RClass* mrb_converter_context_resolve(mrb_state* mrb, struct RClass** slot, mrb_sym name);
+
+inline struct RClass* mrb_converter_time_class(mrb_state* mrb) {
+  mrb_converter_context* ctx = mrb_converter_context_get(mrb);
+  if (likely(ctx->time_class)) return ctx->time_class;
+  return mrb_converter_context_resolve(mrb, &ctx->time_class, MRB_SYM(Time));
+}
+
+inline struct RClass* mrb_converter_set_class(mrb_state* mrb) {
+  mrb_converter_context* ctx = mrb_converter_context_get(mrb);
+  if (likely(ctx->set_class)) return ctx->set_class;
+  return mrb_converter_context_resolve(mrb, &ctx->set_class, MRB_SYM(Set));
+}
+
+inline struct RClass* mrb_converter_struct_class(mrb_state* mrb) {
+  mrb_converter_context* ctx = mrb_converter_context_get(mrb);
+  if (likely(ctx->struct_class)) return ctx->struct_class;
+  return mrb_converter_context_resolve(mrb, &ctx->struct_class, MRB_SYM(Struct));
+}
+
+inline void mrb_converter_note_arena(mrb_state* mrb) {
+#ifdef MRB_DEBUG
+  mrb_converter_context* ctx = mrb_converter_context_get(mrb);
+  int arena_index = mrb_gc_arena_save(mrb);
+  if (arena_index > ctx->arena_high_water) ctx->arena_high_water = arena_index;
+#else
+  (void) mrb;
+#endif
+}
+
+inline void mrb_converter_note(mrb_state* mrb, mrb_conversion_path path, size_t elements, size_t bytes) {
+#ifdef MRB_CONVERSION_STATS
+  mrb_conversion_counter& counter = mrb_converter_context_get(mrb)->conversion_stats[path];
+  counter.calls++;
+  counter.elements += elements;
+  counter.bytes += bytes;
+#else
+  (void) mrb; (void) path; (void) elements; (void) bytes;
+#endif
+}
+
+// Counts a call of path and adds the time until it goes out of scope,
+// an exception raised in between drops the sample.
+class mrb_converter_timer {
+#ifdef MRB_CONVERSION_STATS
+  mrb_conversion_counter& counter;
+  std::chrono::steady_clock::time_point start;
+
+public:
+  mrb_converter_timer(mrb_state* mrb, mrb_conversion_path path)
+  : counter(mrb_converter_context_get(mrb)->conversion_stats[path]), start(std::chrono::steady_clock::now()) {
+    counter.calls++;
+  }
+
+  ~mrb_converter_timer() {
+    counter.nanoseconds += static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+  }
+
+  void add(size_t elements, size_t bytes) {
+    counter.elements += elements;
+    counter.bytes += bytes;
+  }
+#else
+public:
+  mrb_converter_timer(mrb_state*, mrb_conversion_path) {}
+  void add(size_t, size_t) {}
+#endif
+  mrb_converter_timer(const mrb_converter_timer&) = delete;
+  mrb_converter_timer& operator=(const mrb_converter_timer&) = delete;
+};
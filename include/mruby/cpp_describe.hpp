@@ -0,0 +1,75 @@
+#pragma once
+#include <mruby.h>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include "converter_context.hpp"
+
+// Describe the members of a plain struct so it converts to and from an mruby Struct:
+//
+//   struct Point { double x, y, z; };
+//   MRB_CPP_DESCRIBE(Point, x, y, z)
+//
+// cpp_to_mrb_value(mrb, point) then returns an instance of a Struct class with the
+// members x, y and z, which is created once per mrb_state, and mrb_value_to_cpp<Point>
+// accepts such a Struct or a Hash with Symbol keys. Use it at namespace scope.
+template <typename T>
+struct mrb_cpp_describe;
+
+namespace mrbcpp::value_converter {
+  template <typename T, typename = void>
+  struct is_described : std::false_type {};
+
+  template <typename T>
+  struct is_described<T, std::void_t<decltype(mrb_cpp_describe<T>::members)>> : std::true_type {};
+
+  template <typename T>
+  constexpr bool is_described_v = is_described<T>::value;
+
+  template <typename T>
+  constexpr std::size_t described_size_v = std::tuple_size_v<std::remove_const_t<decltype(mrb_cpp_describe<T>::members)>>;
+
+  template <typename T>
+  const mrb_described_struct* described_struct(mrb_state* mrb) {
+    // the address of the names array identifies the type
+    return mrb_converter_context_describe(mrb, mrb_cpp_describe<T>::names, mrb_cpp_describe<T>::names, described_size_v<T>);
+  }
+}
+
+#define MRB_CPP_DESCRIBE_MEMBER_PTR(Type, m) &Type::m
+#define MRB_CPP_DESCRIBE_MEMBER_NAME(Type, m) #m
+
+#define MRB_CPP_DESCRIBE_EXPAND(x) x
+#define MRB_CPP_DESCRIBE_PICK(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, NAME, ...) NAME
+#define MRB_CPP_DESCRIBE_EACH(F, T, ...) \
+  MRB_CPP_DESCRIBE_EXPAND(MRB_CPP_DESCRIBE_PICK(__VA_ARGS__, \
+    MRB_CPP_DESCRIBE_16, MRB_CPP_DESCRIBE_15, MRB_CPP_DESCRIBE_14, MRB_CPP_DESCRIBE_13, \
+    MRB_CPP_DESCRIBE_12, MRB_CPP_DESCRIBE_11, MRB_CPP_DESCRIBE_10, MRB_CPP_DESCRIBE_9, \
+    MRB_CPP_DESCRIBE_8, MRB_CPP_DESCRIBE_7, MRB_CPP_DESCRIBE_6, MRB_CPP_DESCRIBE_5, \
+    MRB_CPP_DESCRIBE_4, MRB_CPP_DESCRIBE_3, MRB_CPP_DESCRIBE_2, MRB_CPP_DESCRIBE_1)(F, T, __VA_ARGS__))
+#define MRB_CPP_DESCRIBE_1(F, T, a) F(T, a)
+#define MRB_CPP_DESCRIBE_2(F, T, a, ...) F(T, a), MRB_CPP_DESCRIBE_EXPAND(MRB_CPP_DESCRIBE_1(F, T, __VA_ARGS__))
+#define MRB_CPP_DESCRIBE_3(F, T, a, ...) F(T, a), MRB_CPP_DESCRIBE_EXPAND(MRB_CPP_DESCRIBE_2(F, T, __VA_ARGS__))
+#define MRB_CPP_DESCRIBE_4(F, T, a, ...) F(T, a), MRB_CPP_DESCRIBE_EXPAND(MRB_CPP_DESCRIBE_3(F, T, __VA_ARGS__))
+#define MRB_CPP_DESCRIBE_5(F, T, a, ...) F(T, a), MRB_CPP_DESCRIBE_EXPAND(MRB_CPP_DESCRIBE_4(F, T, __VA_ARGS__))
+#define MRB_CPP_DESCRIBE_6(F, T, a, ...) F(T, a), MRB_CPP_DESCRIBE_EXPAND(MRB_CPP_DESCRIBE_5(F, T, __VA_ARGS__))
+#define MRB_CPP_DESCRIBE_7(F, T, a, ...) F(T, a), MRB_CPP_DESCRIBE_EXPAND(MRB_CPP_DESCRIBE_6(F, T, __VA_ARGS__))
+#define MRB_CPP_DESCRIBE_8(F, T, a, ...) F(T, a), MRB_CPP_DESCRIBE_EXPAND(MRB_CPP_DESCRIBE_7(F, T, __VA_ARGS__))
+#define MRB_CPP_DESCRIBE_9(F, T, a, ...) F(T, a), MRB_CPP_DESCRIBE_EXPAND(MRB_CPP_DESCRIBE_8(F, T, __VA_ARGS__))
+#define MRB_CPP_DESCRIBE_10(F, T, a, ...) F(T, a), MRB_CPP_DESCRIBE_EXPAND(MRB_CPP_DESCRIBE_9(F, T, __VA_ARGS__))
+#define MRB_CPP_DESCRIBE_11(F, T, a, ...) F(T, a), MRB_CPP_DESCRIBE_EXPAND(MRB_CPP_DESCRIBE_10(F, T, __VA_ARGS__))
+#define MRB_CPP_DESCRIBE_12(F, T, a, ...) F(T, a), MRB_CPP_DESCRIBE_EXPAND(MRB_CPP_DESCRIBE_11(F, T, __VA_ARGS__))
+#define MRB_CPP_DESCRIBE_13(F, T, a, ...) F(T, a), MRB_CPP_DESCRIBE_EXPAND(MRB_CPP_DESCRIBE_12(F, T, __VA_ARGS__))
+#define MRB_CPP_DESCRIBE_14(F, T, a, ...) F(T, a), MRB_CPP_DESCRIBE_EXPAND(MRB_CPP_DESCRIBE_13(F, T, __VA_ARGS__))
+#define MRB_CPP_DESCRIBE_15(F, T, a, ...) F(T, a), MRB_CPP_DESCRIBE_EXPAND(MRB_CPP_DESCRIBE_14(F, T, __VA_ARGS__))
+#define MRB_CPP_DESCRIBE_16(F, T, a, ...) F(T, a), MRB_CPP_DESCRIBE_EXPAND(MRB_CPP_DESCRIBE_15(F, T, __VA_ARGS__))
+
+#define MRB_CPP_DESCRIBE(Type, ...)                                                        \
+  template <>                                                                             \
+  struct mrb_cpp_describe<Type> {                                                         \
+    static constexpr auto members =                                                       \
+      std::make_tuple(MRB_CPP_DESCRIBE_EACH(MRB_CPP_DESCRIBE_MEMBER_PTR, Type, __VA_ARGS__)); \
+    static constexpr const char* names[] = {                                              \
+      MRB_CPP_DESCRIBE_EACH(MRB_CPP_DESCRIBE_MEMBER_NAME, Type, __VA_ARGS__)              \
+    };                                                                                    \
+  };
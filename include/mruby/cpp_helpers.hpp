@@ -6,22 +6,94 @@
 #include <type_traits>
 #include <array>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "cpp_pool.hpp"
+#include "cpp_object_stats.hpp"
+#if __has_include(<mruby/istruct.h>)
+#include <mruby/istruct.h>
+#define MRB_CPP_HAVE_INLINE_STORAGE 1
+#endif
 
 template <typename T, typename Enable = void>
 struct mrb_data_type_traits;
 
+// Where mrb_cpp_new puts objects, chosen by the MRB_CPP_DEFINE_*TYPE macro
+enum class mrb_cpp_storage { heap, pool, inline_data };
+
+// Inline objects are MRB_TT_ISTRUCT, their first word is the mrb_data_type as type tag
+// and T follows, so 16 bytes fit on 64 bit platforms.
+template <typename T>
+constexpr bool mrb_cpp_fits_inline() {
+#ifdef MRB_CPP_HAVE_INLINE_STORAGE
+  return std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T> &&
+         sizeof(const void*) + sizeof(T) <= ISTRUCT_DATA_SIZE && alignof(T) <= alignof(intptr_t);
+#else
+  return false;
+#endif
+}
+
+template <typename T, typename = void>
+struct mrb_cpp_storage_of : std::integral_constant<mrb_cpp_storage, mrb_cpp_storage::heap> {};
+
+template <typename T>
+struct mrb_cpp_storage_of<T, std::void_t<decltype(mrb_data_type_traits<T>::storage)>>
+  : std::integral_constant<mrb_cpp_storage, mrb_data_type_traits<T>::storage> {};
+
+// Instance type to give classes wrapping T with MRB_SET_INSTANCE_TT, MRB_TT_ISTRUCT
+// instances can't hold instance variables
+template <typename T>
+constexpr enum mrb_vtype mrb_cpp_instance_tt() {
+#ifdef MRB_CPP_HAVE_INLINE_STORAGE
+  if constexpr (mrb_cpp_storage_of<T>::value == mrb_cpp_storage::inline_data) return MRB_TT_ISTRUCT;
+#endif
+  return MRB_TT_DATA;
+}
+
 template <typename T, typename... Args>
 T* mrb_cpp_new(mrb_state* mrb, mrb_value self, Args&&... args) {
-  const mrb_data_type* dt = mrb_data_type_traits<T>::get();
-  T* mem = static_cast<T*>(mrb_malloc(mrb, sizeof(T)));
+  using traits = mrb_data_type_traits<T>;
+  const mrb_data_type* dt = traits::get();
+  void* mem;
+#ifdef MRB_CPP_HAVE_INLINE_STORAGE
+  if constexpr (mrb_cpp_storage_of<T>::value == mrb_cpp_storage::inline_data) {
+    static_assert(mrb_cpp_fits_inline<T>(), "subclass does not fit inline storage of its base class");
+    if (unlikely(mrb_type(self) != MRB_TT_ISTRUCT)) {
+      mrb_raisef(mrb, E_TYPE_ERROR, "%s objects need a class with MRB_TT_ISTRUCT instances", dt->struct_name);
+    }
+    char* data = static_cast<char*>(mrb_istruct_ptr(self));
+    std::memcpy(data, &dt, sizeof(dt));
+    return new (data + sizeof(dt)) T(std::forward<Args>(args)...);
+  }
+#endif
+  if constexpr (mrb_cpp_storage_of<T>::value == mrb_cpp_storage::pool) {
+    mem = mrb_cpp_pool_alloc(mrb, dt, traits::slot_size, traits::slot_align, sizeof(T), alignof(T));
+  } else {
+    mem = mrb_malloc(mrb, sizeof(T));
+  }
   mrb_data_init(self, mem, dt);
-  return new (mem) T(std::forward<Args>(args)...);
+  T* obj = new (mem) T(std::forward<Args>(args)...);
+#ifdef MRB_CPP_OBJECT_STATS
+  mrb_cpp_object_stats_add(mrb, dt, mem, sizeof(T), traits::sized_per_object ? traits::size_of : nullptr);
+#endif
+  return obj;
 }
 
 template <typename T>
 void mrb_cpp_delete(mrb_state* mrb, T* ptr) {
   ptr->~T();
-  mrb_free(mrb, ptr);
+  if constexpr (mrb_cpp_storage_of<T>::value == mrb_cpp_storage::inline_data) {
+    // part of the object, nothing to free
+  } else {
+#ifdef MRB_CPP_OBJECT_STATS
+    mrb_cpp_object_stats_remove(mrb, mrb_data_type_traits<T>::get(), ptr, sizeof(T));
+#endif
+    if constexpr (mrb_cpp_storage_of<T>::value == mrb_cpp_storage::pool) {
+      mrb_cpp_pool_free(mrb, ptr);
+    } else {
+      mrb_free(mrb, ptr);
+    }
+  }
 }
 
 // Strip namespaces from a type name
@@ -44,6 +116,29 @@ constexpr auto mrb_cpp_basename(const char (&s)[N]) {
 }
 
 #define MRB_CPP_DEFINE_TYPE(BaseClass, Identifier)                                \
+  MRB_CPP_DEFINE_TYPE_WITH_STORAGE(BaseClass, Identifier,                         \
+    static constexpr mrb_cpp_storage storage = mrb_cpp_storage::heap;)
+
+// Same as MRB_CPP_DEFINE_TYPE, objects come from a per mrb_state slab pool sized for
+// BaseClass and freed slots are reused, see cpp_pool.hpp. Subclasses work as well,
+// the ones bigger than BaseClass are allocated one by one.
+#define MRB_CPP_DEFINE_POOLED_TYPE(BaseClass, Identifier)                         \
+  MRB_CPP_DEFINE_TYPE_WITH_STORAGE(BaseClass, Identifier,                         \
+    static constexpr mrb_cpp_storage storage = mrb_cpp_storage::pool;             \
+    static constexpr std::size_t slot_size = sizeof(BaseClass);                   \
+    static constexpr std::size_t slot_align = alignof(BaseClass);)
+
+// Same as MRB_CPP_DEFINE_TYPE for small trivially copyable types, when BaseClass fits
+// it lives inside the mruby object itself, without a separate allocation.
+// Wrapping classes need MRB_SET_INSTANCE_TT(cls, mrb_cpp_instance_tt<BaseClass>()).
+// MRB_TT_ISTRUCT objects have no instance variables, setting @foo on them or on instances
+// of ruby subclasses raises an ArgumentError, use MRB_CPP_DEFINE_TYPE for classes that need them.
+#define MRB_CPP_DEFINE_INLINE_TYPE(BaseClass, Identifier)                         \
+  MRB_CPP_DEFINE_TYPE_WITH_STORAGE(BaseClass, Identifier,                         \
+    static constexpr mrb_cpp_storage storage = mrb_cpp_fits_inline<BaseClass>()   \
+      ? mrb_cpp_storage::inline_data : mrb_cpp_storage::heap;)
+
+#define MRB_CPP_DEFINE_TYPE_WITH_STORAGE(BaseClass, Identifier, Storage)          \
   static void Identifier##_free(mrb_state* mrb, void* ptr) {                      \
     mrb_cpp_delete<BaseClass>(mrb, static_cast<BaseClass*>(ptr));                 \
   }                                                                               \
@@ -58,6 +153,12 @@ constexpr auto mrb_cpp_basename(const char (&s)[N]) {
   /* Exact BaseClass */                                                           \
   template <>                                                                      \
   struct mrb_data_type_traits<BaseClass, void> {                                  \
+    Storage                                                                       \
+    static constexpr bool sized_per_object =                                      \
+      mrb_cpp_size_is_custom<BaseClass>::value;                                   \
+    static std::size_t size_of(const void* ptr) {                                 \
+      return mrb_cpp_size<BaseClass>::of(*static_cast<const BaseClass*>(ptr));    \
+    }                                                                             \
     static const mrb_data_type* get() {                                           \
       return &Identifier##_type;                                                  \
     }                                                                             \
@@ -68,6 +169,12 @@ constexpr auto mrb_cpp_basename(const char (&s)[N]) {
   struct mrb_data_type_traits<                                                    \
     T, std::enable_if_t<std::is_base_of<BaseClass, T>::value &&                  \
                         !std::is_same<BaseClass, T>::value>> {                    \
+    Storage                                                                       \
+    static constexpr bool sized_per_object =                                      \
+      mrb_cpp_size_is_custom<T>::value || sizeof(T) != sizeof(BaseClass);         \
+    static std::size_t size_of(const void* ptr) {                                 \
+      return mrb_cpp_size<T>::of(*static_cast<const T*>(ptr));                    \
+    }                                                                             \
     static const mrb_data_type* get() {                                           \
       return &Identifier##_type;                                                  \
     }                                                                             \
@@ -76,5 +183,14 @@ constexpr auto mrb_cpp_basename(const char (&s)[N]) {
 template <typename T>
 T* mrb_cpp_get(mrb_state* mrb, mrb_value obj) {
   const mrb_data_type* dt = mrb_data_type_traits<T>::get();
+#ifdef MRB_CPP_HAVE_INLINE_STORAGE
+  if constexpr (mrb_cpp_storage_of<T>::value == mrb_cpp_storage::inline_data) {
+    if (mrb_type(obj) != MRB_TT_ISTRUCT) return nullptr;
+    char* data = static_cast<char*>(mrb_istruct_ptr(obj));
+    const mrb_data_type* tag;
+    std::memcpy(&tag, data, sizeof(tag));
+    return tag == dt ? std::launder(reinterpret_cast<T*>(data + sizeof(tag))) : nullptr;
+  }
+#endif
   return static_cast<T*>(mrb_data_get_ptr(mrb, obj, dt));
 }
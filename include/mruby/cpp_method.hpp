@@ -0,0 +1,148 @@
+#pragma once
+#include <mruby.h>
+#include <mruby/error.h>
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "cpp_helpers.hpp"
+#include "mrb_value_to_cpp.hpp"
+#include "cpp_to_mrb_value.hpp"
+
+// Binds a member function of a type defined with one of the MRB_CPP_DEFINE_*TYPE macros:
+//
+//   mrb_cpp_define_method<&Foo::bar>(mrb, cls, "bar");
+//
+// Arguments are taken straight from the call frame and converted with mrb_value_to_cpp
+// for the parameter types of Foo::bar, the result goes through cpp_to_mrb_value.
+// void returns nil, returning *this by reference returns self.
+// Arguments already converted are released before an error of a later one is raised,
+// calls where nothing needs destroying skip that protection and convert in place.
+template <typename M>
+struct mrb_cpp_member_fn;
+
+template <typename C, typename R, typename... A>
+struct mrb_cpp_member_fn<R (C::*)(A...)> {
+  using cls = C;
+  using ret = R;
+  using params = std::tuple<A...>;
+  using args = std::tuple<std::remove_cv_t<std::remove_reference_t<A>>...>;
+};
+
+template <typename C, typename R, typename... A>
+struct mrb_cpp_member_fn<R (C::*)(A...) const> : mrb_cpp_member_fn<R (C::*)(A...)> {};
+
+template <typename C, typename R, typename... A>
+struct mrb_cpp_member_fn<R (C::*)(A...) noexcept> : mrb_cpp_member_fn<R (C::*)(A...)> {};
+
+template <typename C, typename R, typename... A>
+struct mrb_cpp_member_fn<R (C::*)(A...) const noexcept> : mrb_cpp_member_fn<R (C::*)(A...)> {};
+
+namespace mrbcpp::method {
+  template <typename Args>
+  struct arg_slots;
+
+  // one slot per argument, filled left to right, so the ones converted before a raise
+  // are still destroyed
+  template <typename... A>
+  struct arg_slots<std::tuple<A...>> {
+    using type = std::tuple<std::optional<A>...>;
+  };
+
+  template <typename Args, std::size_t... I>
+  void convert_args(mrb_state* mrb, const std::array<mrb_value, sizeof...(I)>& argv, typename arg_slots<Args>::type& slots, std::index_sequence<I...>) {
+    (std::get<I>(slots).emplace(mrb_value_to_cpp<std::tuple_element_t<I, Args>>(mrb, argv[I])), ...);
+  }
+
+  // hands every argument over the way the parameter takes it, by value ones are moved
+  template <auto Method, typename C, typename Slots, std::size_t... I>
+  decltype(auto) invoke(C* obj, Slots& slots, std::index_sequence<I...>) {
+    using params = typename mrb_cpp_member_fn<decltype(Method)>::params;
+    return (obj->*Method)(std::forward<std::tuple_element_t<I, params>>(*std::get<I>(slots))...);
+  }
+
+  // Everything the call creates on the C++ side, it lives in the frame of call(). If any
+  // of it has a destructor the conversions run under mrb_protect_error, so their errors
+  // are only raised again once it has been destroyed. The arguments are copied out of the
+  // VM stack, converting one may run ruby code that reallocates it.
+  template <auto Method>
+  struct call_state {
+    using fn = mrb_cpp_member_fn<decltype(Method)>;
+    using C = typename fn::cls;
+    using R = typename fn::ret;
+    using Args = typename fn::args;
+    using value_type = std::conditional_t<std::is_void_v<R> || std::is_reference_v<R>, char, R>;
+
+    static constexpr std::size_t arity = std::tuple_size_v<Args>;
+    static constexpr bool trivial = std::is_trivially_destructible_v<typename arg_slots<Args>::type>
+                                    && std::is_trivially_destructible_v<value_type>;
+
+    C* obj;
+    mrb_value self;
+    std::array<mrb_value, arity> argv;
+    typename arg_slots<Args>::type args;
+    std::optional<value_type> value;
+
+    static mrb_value run(mrb_state* mrb, void* data) {
+      call_state& st = *static_cast<call_state*>(data);
+      constexpr auto seq = std::make_index_sequence<arity>();
+      convert_args<Args>(mrb, st.argv, st.args, seq);
+
+      if constexpr (std::is_void_v<R>) {
+        invoke<Method>(st.obj, st.args, seq);
+        return mrb_nil_value();
+      } else if constexpr (std::is_lvalue_reference_v<R> && std::is_same_v<std::remove_cv_t<std::remove_reference_t<R>>, C>) {
+        R result = invoke<Method>(st.obj, st.args, seq);
+        if (unlikely(&result != st.obj)) mrb_raise(mrb, E_RUNTIME_ERROR, "method returned a reference to another object");
+        return st.self;
+      } else if constexpr (std::is_reference_v<R>) {
+        return cpp_to_mrb_value(mrb, invoke<Method>(st.obj, st.args, seq));
+      } else {
+        st.value.emplace(invoke<Method>(st.obj, st.args, seq));
+        return cpp_to_mrb_value(mrb, *st.value);
+      }
+    }
+  };
+
+  template <auto Method>
+  mrb_value call(mrb_state* mrb, mrb_value self) {
+    using state = call_state<Method>;
+    using C = typename state::C;
+    constexpr std::size_t arity = state::arity;
+
+    mrb_int argc = mrb_get_argc(mrb);
+    if (unlikely(argc != static_cast<mrb_int>(arity))) {
+      mrb_raisef(mrb, E_ARGUMENT_ERROR, "wrong number of arguments (given %i, expected %i)", argc, static_cast<mrb_int>(arity));
+    }
+    C* obj = mrb_cpp_get<C>(mrb, self);
+    if (unlikely(!obj)) {
+      mrb_raisef(mrb, E_RUNTIME_ERROR, "uninitialized %s", mrb_data_type_traits<C>::get()->struct_name);
+    }
+
+    const mrb_value* argv = mrb_get_argv(mrb);
+    if constexpr (state::trivial) {
+      // nothing to release, a raise may leave this frame directly
+      state st{obj, self, {}, {}, {}};
+      std::copy_n(argv, arity, st.argv.begin());
+      return state::run(mrb, &st);
+    }
+
+    mrb_bool failed;
+    mrb_value result;
+    {
+      state st{obj, self, {}, {}, {}};
+      std::copy_n(argv, arity, st.argv.begin());
+      result = mrb_protect_error(mrb, state::run, &st, &failed);
+    }
+    if (unlikely(failed)) mrb_exc_raise(mrb, result);
+    return result;
+  }
+}
+
+template <auto Method>
+void mrb_cpp_define_method(mrb_state* mrb, struct RClass* cls, const char* name) {
+  constexpr auto arity = std::tuple_size_v<typename mrb_cpp_member_fn<decltype(Method)>::args>;
+  mrb_define_method(mrb, cls, name, mrbcpp::method::call<Method>, MRB_ARGS_REQ(arity));
+}
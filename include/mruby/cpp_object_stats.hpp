@@ -0,0 +1,48 @@
+#pragma once
+#include <mruby.h>
+#include <mruby/data.h>
+#include <cstddef>
+
+#include <type_traits>
+#include <unordered_map>
+
+// Per mrb_state counters of objects created with mrb_cpp_new, kept when MRB_CPP_OBJECT_STATS
+// is defined. Inline types aren't counted, mruby frees those without telling anyone.
+struct mrb_cpp_object_stats {
+  size_t live = 0;
+  size_t allocated = 0;
+  size_t freed = 0;
+  size_t bytes = 0;      // of the live objects
+};
+
+// Bytes held by an object, specialize it for types which own memory behind pointers
+template <typename T>
+struct mrb_cpp_size {
+  using fixed = void;    // only in the primary template
+  static size_t of(const T&) { return sizeof(T); }
+};
+
+template <typename T, typename = void>
+struct mrb_cpp_size_is_custom : std::true_type {};
+
+template <typename T>
+struct mrb_cpp_size_is_custom<T, std::void_t<typename mrb_cpp_size<T>::fixed>> : std::false_type {};
+
+typedef size_t (*mrb_cpp_size_fn)(const void* ptr);
+
+// Objects of a fixed size are only counted. Those whose size can change (a specialized
+// mrb_cpp_size) or differs from the one their mrb_data_type is freed with (subclasses
+// bigger than the base) remember their size function and are measured on every read.
+struct mrb_cpp_object_counter {
+  mrb_cpp_object_stats stats;
+  size_t fixed_bytes = 0;
+  std::unordered_map<const void*, mrb_cpp_size_fn> sized;
+};
+
+// size_of is nullptr for objects of a fixed size, they add size bytes
+MRB_API void mrb_cpp_object_stats_add(mrb_state* mrb, const mrb_data_type* type, const void* ptr, size_t size, mrb_cpp_size_fn size_of);
+// size is the one of the type the object is freed as
+MRB_API void mrb_cpp_object_stats_remove(mrb_state* mrb, const mrb_data_type* type, const void* ptr, size_t size);
+// Sums up the bytes of the live objects of this type, without running the GC.
+// Returns false when no object of this type was counted yet.
+MRB_API mrb_bool mrb_cpp_object_stats_get(mrb_state* mrb, const mrb_data_type* type, mrb_cpp_object_stats* stats);
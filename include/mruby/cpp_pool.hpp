@@ -0,0 +1,26 @@
+#pragma once
+#include <mruby.h>
+#include <mruby/data.h>
+#include <cstddef>
+
+// Slab pool behind MRB_CPP_DEFINE_POOLED_TYPE, one per mrb_state and data type.
+// Every object carries a header word in front of it naming the pool it came from,
+// so objects can be given back without looking anything up, even while the
+// mrb_state is being closed. Objects which don't fit a slot, e.g. a bigger subclass,
+// or which are created after the gem got finalized, are taken from mrb_malloc instead.
+struct mrb_cpp_pool;
+
+struct mrb_cpp_pool_stats {
+  size_t slot_size = 0;    // bytes per slot, header included
+  size_t slabs = 0;
+  size_t capacity = 0;     // slots in all slabs
+  size_t live = 0;
+  size_t allocations = 0;
+  size_t recycled = 0;     // allocations served from the free list
+  size_t fallbacks = 0;    // allocations which went to mrb_malloc
+};
+
+MRB_API void* mrb_cpp_pool_alloc(mrb_state* mrb, const mrb_data_type* type, size_t slot_size, size_t slot_align, size_t size, size_t align);
+MRB_API void mrb_cpp_pool_free(mrb_state* mrb, void* ptr);
+// Returns false when no object of this type was created from a pool yet
+MRB_API mrb_bool mrb_cpp_pool_stats_get(mrb_state* mrb, const mrb_data_type* type, mrb_cpp_pool_stats* stats);
@@ -1,6 +1,7 @@
 #pragma once
 #include <mruby.h>
 #include <mruby/array.h>
+#include <mruby/class.h>
 #include <mruby/hash.h>
 #include <mruby/presym.h>
 #include <string>
@@ -15,41 +16,13 @@
 #include "branch_pred.h"
 #include <chrono>
 #include "num_helpers.hpp"
+#include "cpp_type_traits.hpp"
+#include "bulk_convert.hpp"
+#include "converter_context.hpp"
+#include "cpp_describe.hpp"
+#include "key_table.hpp"
 
 namespace mrbcpp::value_converter {
-  template <typename T, typename = void>
-  struct is_iterable : std::false_type {};
-
-  template <typename T>
-  struct is_iterable<T, std::void_t<
-    decltype(std::begin(std::declval<T>())),
-    decltype(std::end(std::declval<T>()))>> : std::true_type {};
-
-  template <typename T>
-  constexpr bool is_iterable_v = is_iterable<T>::value;
-
-  template <typename T>
-  struct is_map_like : std::false_type {};
-
-  template <typename Key, typename Val>
-  struct is_map_like<std::map<Key, Val>> : std::true_type {};
-  template <typename Key, typename Val>
-  struct is_map_like<std::unordered_map<Key, Val>> : std::true_type {};
-
-  template <typename T>
-  constexpr bool is_map_like_v = is_map_like<T>::value;
-
-  template <typename T>
-  struct is_set_like : std::false_type {};
-
-  template <typename Val>
-  struct is_set_like<std::set<Val>> : std::true_type {};
-  template <typename Val>
-  struct is_set_like<std::unordered_set<Val>> : std::true_type {};
-
-  template <typename T>
-  constexpr bool is_set_like_v = is_set_like<T>::value;
-
   template <typename Clock, typename Duration>
   std::chrono::system_clock::time_point to_system_time(std::chrono::time_point<Clock, Duration> tp) {
     return std::chrono::system_clock::time_point(
@@ -58,64 +31,119 @@ namespace mrbcpp::value_converter {
   }
 
   template <typename T>
-  struct is_time_point : std::false_type {};
-
-  template <typename Clock, typename Duration>
-  struct is_time_point<std::chrono::time_point<Clock, Duration>> : std::true_type {};
+  struct mrb_converter;
 
+  // Converts without an extra mrb_gc_protect, the result only holds the arena slot it was
+  // created with. Children are made reachable through their container right away and the
+  // arena is rolled back after each of them, so a conversion needs one arena slot per
+  // nesting level no matter how wide the input is.
+  // keys, when given, supplies the String keys of every map on the way down.
   template <typename T>
-  constexpr bool is_time_point_v = is_time_point<T>::value;
-
+  mrb_value to_mrb(mrb_state* mrb, T&& val, mrb_key_table* keys = nullptr) {
+    return mrb_converter<std::decay_t<T>>::convert(mrb, val, keys);
+  }
 
   template <typename T>
   struct mrb_converter {
-    static constexpr mrb_value convert(mrb_state* mrb, const T& val) {
+    static constexpr mrb_value convert(mrb_state* mrb, const T& val, mrb_key_table* keys = nullptr) {
       if constexpr (std::is_same_v<T, bool>) {
+        mrb_converter_note(mrb, MRB_CONV_SCALAR, 1, 0);
         return mrb_bool_value(val);
       } else if constexpr (std::is_arithmetic_v<T>) {
+        mrb_converter_note(mrb, MRB_CONV_SCALAR, 1, 0);
         return mrb_convert_number(mrb, val);
       } else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>) {
+        mrb_converter_note(mrb, MRB_CONV_STRING, 1, val.size());
         return mrb_str_new(mrb, val.data(), val.size());
       } else if constexpr (std::is_same_v<T, const char*>) {
-        return mrb_str_new_cstr(mrb, val);
+        mrb_value str = mrb_str_new_cstr(mrb, val);
+        mrb_converter_note(mrb, MRB_CONV_STRING, 1, static_cast<size_t>(RSTRING_LEN(str)));
+        return str;
       } else if constexpr (std::is_same_v<T, std::nullptr_t>) {
+        mrb_converter_note(mrb, MRB_CONV_SCALAR, 1, 0);
         return mrb_nil_value();
       } else if constexpr (is_map_like_v<T>) {
-        mrb_value hash = mrb_hash_new(mrb);
-        mrb_gc_protect(mrb, hash);
+        using K = typename T::key_type;
+        mrb_converter_note(mrb, MRB_CONV_MAP, std::size(val), 0);
+        mrb_value hash = mrb_hash_new_capa(mrb, static_cast<mrb_int>(std::size(val)));
         int arena_index = mrb_gc_arena_save(mrb);
         for (const auto& [k, v] : val) {
-          mrb_hash_set(mrb, hash,
-            cpp_to_mrb_value(mrb, k),
-            cpp_to_mrb_value(mrb, v));
+          mrb_value key;
+          if constexpr (std::is_convertible_v<const K&, std::string_view>) {
+            key = keys ? keys->get(k) : to_mrb(mrb, k);
+          } else {
+            key = to_mrb(mrb, k, keys);
+          }
+          mrb_hash_set(mrb, hash, key, to_mrb(mrb, v, keys));
+          mrb_converter_note_arena(mrb);
           mrb_gc_arena_restore(mrb, arena_index);
         }
         return hash;
       } else if constexpr (is_set_like_v<T>) {
-        struct RClass* set_class = mrb_class_get_id(mrb, MRB_SYM(Set));
-        if (unlikely(!set_class)) {
-          mrb_raise(mrb, E_NAME_ERROR, "Set class not defined — is it included in your mruby build?");
-        }
+        struct RClass* set_class = mrb_converter_set_class(mrb);
+        mrb_converter_note(mrb, MRB_CONV_SET, std::size(val), 0);
 
+#ifdef MRB_USE_SET
+        // The C implemented Set takes all members from one pre-sized Array in a single call
+        mrb_value members = mrb_ary_new_capa(mrb, static_cast<mrb_int>(std::size(val)));
+        int arena_index = mrb_gc_arena_save(mrb);
+        for (const auto& item : val) {
+          mrb_ary_push(mrb, members, to_mrb(mrb, item, keys));
+          mrb_converter_note_arena(mrb);
+          mrb_gc_arena_restore(mrb, arena_index);
+        }
+        return mrb_obj_new(mrb, set_class, 1, &members);
+#else
         mrb_value ruby_set = mrb_obj_new(mrb, set_class, 0, nullptr);
-        mrb_gc_protect(mrb, ruby_set);
         int arena_index = mrb_gc_arena_save(mrb);
         for (const auto& item : val) {
-          mrb_funcall_id(mrb, ruby_set, MRB_SYM(add), 1, cpp_to_mrb_value(mrb, item));
+          mrb_funcall_id(mrb, ruby_set, MRB_SYM(add), 1, to_mrb(mrb, item, keys));
+          mrb_converter_note_arena(mrb);
           mrb_gc_arena_restore(mrb, arena_index);
         }
         return ruby_set;
+#endif
+      } else if constexpr (is_described_v<T>) {
+        // members are set by position on an instance of the cached Struct class, Struct
+        // instances are Arrays of their members, so Struct#initialize isn't dispatched
+        constexpr std::size_t n = described_size_v<T>;
+        const mrb_described_struct* desc = described_struct<T>(mrb);
+        mrb_converter_note(mrb, MRB_CONV_STRUCT, n, 0);
+        mrb_value argv[n];
+        int arena_index = mrb_gc_arena_save(mrb);
+        std::apply([&](auto... member) {
+          std::size_t i = 0;
+          ((argv[i++] = to_mrb(mrb, val.*member, keys)), ...);
+        }, mrb_cpp_describe<T>::members);
+        mrb_value obj;
+        if (likely(MRB_INSTANCE_TT(desc->cls) == MRB_TT_STRUCT)) {
+          obj = mrb_obj_value(mrb_obj_alloc(mrb, MRB_TT_STRUCT, desc->cls));
+          mrb_ary_resize(mrb, obj, static_cast<mrb_int>(n));
+          for (std::size_t i = 0; i < n; ++i) mrb_ary_set(mrb, obj, static_cast<mrb_int>(i), argv[i]);
+        } else {
+          // a Struct replaced by something else, leave it to its initialize
+          obj = mrb_obj_new(mrb, desc->cls, static_cast<mrb_int>(n), argv);
+        }
+        mrb_converter_note_arena(mrb);
+        mrb_gc_arena_restore(mrb, arena_index);
+        mrb_gc_protect(mrb, obj);
+        return obj;
+      } else if constexpr (is_contiguous_arithmetic_v<T>) {
+        mrb_converter_note(mrb, MRB_CONV_NUMBERS, std::size(val), std::size(val) * sizeof(*std::data(val)));
+        return mrb_ary_from_numbers(mrb, std::data(val), std::size(val));
       } else if constexpr (is_iterable_v<T>) {
+        mrb_converter_note(mrb, MRB_CONV_ARRAY, std::size(val), 0);
         mrb_value ary = mrb_ary_new_capa(mrb, static_cast<mrb_int>(std::size(val)));
-        mrb_gc_protect(mrb, ary);
         int arena_index = mrb_gc_arena_save(mrb);
         for (const auto& item : val) {
-          mrb_ary_push(mrb, ary, cpp_to_mrb_value(mrb, item));
+          mrb_ary_push(mrb, ary, to_mrb(mrb, item, keys));
+          mrb_converter_note_arena(mrb);
           mrb_gc_arena_restore(mrb, arena_index);
         }
         return ary;
       } else if constexpr (is_time_point_v<T>) {
         using namespace std::chrono;
+        mrb_converter_note(mrb, MRB_CONV_TIME, 1, 0);
 
         auto sys_tp = to_system_time(val);
         time_t time = system_clock::to_time_t(sys_tp);
@@ -123,16 +151,9 @@ namespace mrbcpp::value_converter {
         auto micros = duration_cast<microseconds>(duration).count() % 1000000;
 
         mrb_value sec = mrb_convert_number(mrb, time);
-        mrb_gc_protect(mrb, sec);
         mrb_value usec = mrb_convert_number(mrb, micros);
-        mrb_gc_protect(mrb, usec);
-
-        struct RClass* time_class = mrb_class_get_id(mrb, MRB_SYM(Time));
-        if (unlikely(!time_class)) {
-          mrb_raise(mrb, E_NAME_ERROR, "Time class not defined — is it included in your mruby build?");
-        }
 
-        return mrb_funcall_id(mrb, mrb_obj_value(time_class), MRB_SYM(at), 2, sec, usec);
+        return mrb_funcall_id(mrb, mrb_obj_value(mrb_converter_time_class(mrb)), MRB_SYM(at), 2, sec, usec);
       } else {
         static_assert(sizeof(T) == 0, "Type not supported by mrb_converter");
       }
@@ -141,9 +162,27 @@ namespace mrbcpp::value_converter {
 
 }
 
+namespace mrbcpp::value_converter {
+  template <typename T>
+  mrb_value to_mrb_protected(mrb_state* mrb, T&& val, mrb_key_table* keys) {
+    mrb_converter_timer timer(mrb, MRB_CONV_CPP_TO_MRB);
+    int arena_index = mrb_gc_arena_save(mrb);
+    mrb_value mruby_val = to_mrb(mrb, std::forward<T>(val), keys);
+    mrb_gc_arena_restore(mrb, arena_index);
+    mrb_gc_protect(mrb, mruby_val);
+    return mruby_val;
+  }
+}
+
+// Converts val and protects only the result, everything created on the way is released
+// from the arena again, so each call takes exactly one arena slot.
 template <typename T>
 constexpr MRB_API mrb_value cpp_to_mrb_value(mrb_state* mrb, T&& val) {
-  mrb_value mruby_val = mrbcpp::value_converter::mrb_converter<std::decay_t<T>>::convert(mrb, std::forward<T>(val));
-  mrb_gc_protect(mrb, mruby_val);
-  return mruby_val;
+  return mrbcpp::value_converter::to_mrb_protected(mrb, std::forward<T>(val), nullptr);
+}
+
+// Same as above, String keys of maps are taken from keys, see key_table.hpp
+template <typename T>
+MRB_API mrb_value cpp_to_mrb_value(mrb_state* mrb, T&& val, mrb_key_table& keys) {
+  return mrbcpp::value_converter::to_mrb_protected(mrb, std::forward<T>(val), &keys);
 }
@@ -0,0 +1,104 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <set>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+namespace mrbcpp::value_converter {
+  template <typename T, typename = void>
+  struct is_iterable : std::false_type {};
+
+  template <typename T>
+  struct is_iterable<T, std::void_t<
+    decltype(std::begin(std::declval<T>())),
+    decltype(std::end(std::declval<T>()))>> : std::true_type {};
+
+  template <typename T>
+  constexpr bool is_iterable_v = is_iterable<T>::value;
+
+  template <typename T>
+  struct is_map_like : std::false_type {};
+
+  template <typename Key, typename Val>
+  struct is_map_like<std::map<Key, Val>> : std::true_type {};
+  template <typename Key, typename Val>
+  struct is_map_like<std::unordered_map<Key, Val>> : std::true_type {};
+
+  template <typename T>
+  constexpr bool is_map_like_v = is_map_like<T>::value;
+
+  template <typename T>
+  struct is_set_like : std::false_type {};
+
+  template <typename Val>
+  struct is_set_like<std::set<Val>> : std::true_type {};
+  template <typename Val>
+  struct is_set_like<std::unordered_set<Val>> : std::true_type {};
+
+  template <typename T>
+  constexpr bool is_set_like_v = is_set_like<T>::value;
+
+  template <typename T>
+  struct is_std_array : std::false_type {};
+
+  template <typename Val, std::size_t N>
+  struct is_std_array<std::array<Val, N>> : std::true_type {};
+
+  template <typename T>
+  constexpr bool is_std_array_v = is_std_array<T>::value;
+
+  template <typename T>
+  struct is_optional : std::false_type {};
+
+  template <typename Val>
+  struct is_optional<std::optional<Val>> : std::true_type {};
+
+  template <typename T>
+  constexpr bool is_optional_v = is_optional<T>::value;
+
+  // Sequence containers we can append to: vector, deque, list
+  template <typename T, typename = void>
+  struct is_sequence_like : std::false_type {};
+
+  template <typename T>
+  struct is_sequence_like<T, std::void_t<
+    typename T::value_type,
+    decltype(std::declval<T&>().push_back(std::declval<typename T::value_type>()))>> : std::true_type {};
+
+  template <typename T>
+  constexpr bool is_sequence_like_v = is_sequence_like<T>::value;
+
+  template <typename T, typename = void>
+  struct has_reserve : std::false_type {};
+
+  template <typename T>
+  struct has_reserve<T, std::void_t<
+    decltype(std::declval<T&>().reserve(std::declval<std::size_t>()))>> : std::true_type {};
+
+  template <typename T>
+  constexpr bool has_reserve_v = has_reserve<T>::value;
+
+  template <typename T>
+  struct is_pair : std::false_type {};
+
+  template <typename First, typename Second>
+  struct is_pair<std::pair<First, Second>> : std::true_type {};
+
+  template <typename T>
+  constexpr bool is_pair_v = is_pair<T>::value;
+
+  template <typename T>
+  struct is_time_point : std::false_type {};
+
+  template <typename Clock, typename Duration>
+  struct is_time_point<std::chrono::time_point<Clock, Duration>> : std::true_type {};
+
+  template <typename T>
+  constexpr bool is_time_point_v = is_time_point<T>::value;
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <mruby.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+namespace mrbcpp::endian {
+  enum class order { little, big,
+#ifdef MRB_ENDIAN_BIG
+    native = big
+#else
+    native = little
+#endif
+  };
+
+  template <std::size_t N> struct uint_of_size;
+  template <> struct uint_of_size<1> { using type = uint8_t; };
+  template <> struct uint_of_size<2> { using type = uint16_t; };
+  template <> struct uint_of_size<4> { using type = uint32_t; };
+  template <> struct uint_of_size<8> { using type = uint64_t; };
+#if defined(__SIZEOF_INT128__)
+  template <> struct uint_of_size<16> { using type = unsigned __int128; };
+#endif
+
+  template <std::size_t N>
+  using uint_of_size_t = typename uint_of_size<N>::type;
+
+  template <typename U>
+  constexpr U bswap_uint(U v) {
+    static_assert(std::is_unsigned_v<U>
+#if defined(__SIZEOF_INT128__)
+                  || std::is_same_v<U, unsigned __int128>
+#endif
+                  , "expected an unsigned integer");
+    if constexpr (sizeof(U) == 1) {
+      return v;
+#if defined(__GNUC__) || defined(__clang__)
+    } else if constexpr (sizeof(U) == 2) {
+      return __builtin_bswap16(v);
+    } else if constexpr (sizeof(U) == 4) {
+      return __builtin_bswap32(v);
+    } else if constexpr (sizeof(U) == 8) {
+      return __builtin_bswap64(v);
+    } else if constexpr (sizeof(U) == 16) {
+      return (static_cast<U>(__builtin_bswap64(static_cast<uint64_t>(v))) << 64) |
+              static_cast<U>(__builtin_bswap64(static_cast<uint64_t>(v >> 64)));
+#endif
+    } else {
+      U r = 0;
+      for (std::size_t i = 0; i < sizeof(U); ++i) {
+        r = static_cast<U>((r << 8) | (v & 0xff));
+        v = static_cast<U>(v >> 8);
+      }
+      return r;
+    }
+  }
+
+  // Byte swap any trivially copyable number, floats go through their bit pattern
+  template <typename T>
+  inline T bswap(T v) {
+    using U = uint_of_size_t<sizeof(T)>;
+    U bits;
+    std::memcpy(&bits, &v, sizeof(T));
+    bits = bswap_uint(bits);
+    std::memcpy(&v, &bits, sizeof(T));
+    return v;
+  }
+
+  // Store v as sizeof(T) bytes in byte order O, compiles down to a store plus a bswap
+  template <typename T, order O>
+  inline void encode(void* dst, T v) {
+    if constexpr (O != order::native && sizeof(T) > 1) v = bswap(v);
+    std::memcpy(dst, &v, sizeof(T));
+  }
+
+  // Load a T stored in byte order O, compiles down to a load plus a bswap
+  template <typename T, order O>
+  inline T decode(const void* src) {
+    T v;
+    std::memcpy(&v, src, sizeof(T));
+    if constexpr (O != order::native && sizeof(T) > 1) v = bswap(v);
+    return v;
+  }
+
+  // Reverse every width sized element of buf in place, width must be 1, 2, 4, 8 or 16,
+  // returns false and leaves buf alone for any other width
+  inline bool bswap_buffer(void* buf, std::size_t count, std::size_t width) {
+    switch (width) {
+      case 1: return true;
+      case 2: case 4: case 8: case 16: break;
+      default: return false;
+    }
+    uint8_t* p = static_cast<uint8_t*>(buf);
+    std::size_t i = 0;
+#if defined(__AVX2__) || defined(__SSSE3__)
+    alignas(16) static const uint8_t masks[4][16] = {
+      {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14},
+      {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12},
+      {7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8},
+      {15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0}
+    };
+    const uint8_t* mask = masks[width == 2 ? 0 : width == 4 ? 1 : width == 8 ? 2 : 3];
+    std::size_t bytes = count * width;
+#if defined(__AVX2__)
+    const __m256i m256 = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(mask)));
+    for (; i + 32 <= bytes; i += 32) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(p + i), _mm256_shuffle_epi8(v, m256));
+    }
+#endif
+    const __m128i m128 = _mm_load_si128(reinterpret_cast<const __m128i*>(mask));
+    for (; i + 16 <= bytes; i += 16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(p + i), _mm_shuffle_epi8(v, m128));
+    }
+    i /= width;
+#endif
+    for (; i < count; ++i) {
+      uint8_t* e = p + i * width;
+      switch (width) {
+        case 2: { uint16_t v; std::memcpy(&v, e, 2); v = bswap_uint(v); std::memcpy(e, &v, 2); break; }
+        case 4: { uint32_t v; std::memcpy(&v, e, 4); v = bswap_uint(v); std::memcpy(e, &v, 4); break; }
+        case 8: { uint64_t v; std::memcpy(&v, e, 8); v = bswap_uint(v); std::memcpy(e, &v, 8); break; }
+        case 16: {
+          uint64_t lo, hi;
+          std::memcpy(&lo, e, 8);
+          std::memcpy(&hi, e + 8, 8);
+          lo = bswap_uint(lo);
+          hi = bswap_uint(hi);
+          std::memcpy(e, &hi, 8);
+          std::memcpy(e + 8, &lo, 8);
+          break;
+        }
+      }
+    }
+    return true;
+  }
+}
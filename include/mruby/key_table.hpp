@@ -0,0 +1,56 @@
+#pragma once
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/string.h>
+#include <string_view>
+#include <unordered_map>
+
+enum class mrb_key_mode { frozen_strings, symbols };
+
+// Reuses one mruby value per distinct map key while converting C++ maps, either a
+// frozen String (a Hash stores frozen String keys without copying them) or a Symbol.
+// A table can be reused for any number of conversions, the Strings it hands out stay
+// alive as long as the table does.
+class mrb_key_table {
+public:
+  explicit mrb_key_table(mrb_state* mrb, mrb_key_mode mode = mrb_key_mode::frozen_strings)
+  : mrb_(mrb), mode_(mode), strings_(mrb_nil_value()) {
+    if (mode_ == mrb_key_mode::frozen_strings) {
+      strings_ = mrb_ary_new(mrb_);
+      mrb_gc_register(mrb_, strings_);
+    }
+  }
+
+  ~mrb_key_table() {
+    if (mode_ == mrb_key_mode::frozen_strings) {
+      mrb_gc_unregister(mrb_, strings_);
+    }
+  }
+
+  mrb_key_table(const mrb_key_table&) = delete;
+  mrb_key_table& operator=(const mrb_key_table&) = delete;
+
+  mrb_value get(std::string_view key) {
+    if (mode_ == mrb_key_mode::symbols) {
+      return mrb_symbol_value(mrb_intern(mrb_, key.data(), key.size()));
+    }
+    auto it = interned_.find(key);
+    if (it != interned_.end()) return it->second;
+
+    mrb_value str = mrb_str_new(mrb_, key.data(), key.size());
+    mrb_obj_freeze(mrb_, str);
+    mrb_ary_push(mrb_, strings_, str);
+    // the view points into the frozen String, which never moves or changes
+    interned_.emplace(std::string_view(RSTRING_PTR(str), RSTRING_LEN(str)), str);
+    return str;
+  }
+
+  std::size_t size() const { return interned_.size(); }
+  mrb_key_mode mode() const { return mode_; }
+
+private:
+  mrb_state* mrb_;
+  mrb_key_mode mode_;
+  mrb_value strings_;
+  std::unordered_map<std::string_view, mrb_value> interned_;
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include <mruby.h>
+#include <mruby/string.h>
+#include <cstddef>
+#include <string_view>
+#include "branch_pred.h"
+#if __has_include(<span>) && __cplusplus > 201703L
+#include <span>
+#endif
+
+#if defined(__cpp_lib_span)
+using mrb_bytes_view = std::span<const std::byte>;
+#else
+// Minimal stand-in for std::span<const std::byte> on C++17
+struct mrb_bytes_view {
+  const std::byte* ptr = nullptr;
+  std::size_t len = 0;
+
+  constexpr mrb_bytes_view() = default;
+  constexpr mrb_bytes_view(const std::byte* p, std::size_t n) : ptr(p), len(n) {}
+
+  constexpr const std::byte* data() const { return ptr; }
+  constexpr std::size_t size() const { return len; }
+  constexpr bool empty() const { return len == 0; }
+  constexpr const std::byte* begin() const { return ptr; }
+  constexpr const std::byte* end() const { return ptr + len; }
+  constexpr const std::byte& operator[](std::size_t i) const { return ptr[i]; }
+};
+#endif
+
+// Borrow the bytes of a String or the name of a Symbol without copying.
+// A String view points into RSTRING_PTR and stays valid as long as the String is alive
+// and not modified. Short Symbol names are unpacked into a buffer of the mrb_state which
+// the next name lookup overwrites, use Symbol views right away or borrow them through
+// mrb_str_borrow, which backs them with a String.
+inline std::string_view mrb_str_view(mrb_state* mrb, mrb_value val) {
+  if (likely(mrb_string_p(val))) {
+    return std::string_view(RSTRING_PTR(val), static_cast<std::size_t>(RSTRING_LEN(val)));
+  }
+  if (mrb_symbol_p(val)) {
+    mrb_int len;
+    const char* s = mrb_sym_name_len(mrb, mrb_symbol(val), &len);
+    return std::string_view(s, static_cast<std::size_t>(len));
+  }
+  mrb_raise(mrb, E_TYPE_ERROR, "not a String or Symbol");
+}
+
+inline mrb_bytes_view mrb_str_bytes(mrb_state* mrb, mrb_value val) {
+  std::string_view sv = mrb_str_view(mrb, val);
+  return mrb_bytes_view(reinterpret_cast<const std::byte*>(sv.data()), sv.size());
+}
+
+enum class mrb_pin {
+  arena, // mrb_gc_protect, released by the callers next mrb_gc_arena_restore
+  root   // mrb_gc_register, released when the guard goes out of scope
+};
+
+// Scoped guard which keeps the borrowed String reachable for the GC while the view is in use.
+// Symbols are borrowed through their name as a String, value() returns that String.
+// Don't modify the String while a guard is alive, that would invalidate the view.
+class mrb_str_borrow {
+public:
+  mrb_str_borrow(mrb_state* mrb, mrb_value val, mrb_pin pin = mrb_pin::arena)
+  : mrb_(mrb), val_(mrb_symbol_p(val) ? mrb_sym_str(mrb, mrb_symbol(val)) : val),
+    view_(mrb_str_view(mrb, val_)), pin_(pin) {
+    if (pin_ == mrb_pin::root) {
+      mrb_gc_register(mrb_, val_);
+    } else {
+      mrb_gc_protect(mrb_, val_);
+    }
+  }
+
+  ~mrb_str_borrow() {
+    if (pin_ == mrb_pin::root) {
+      mrb_gc_unregister(mrb_, val_);
+    }
+  }
+
+  mrb_str_borrow(const mrb_str_borrow&) = delete;
+  mrb_str_borrow& operator=(const mrb_str_borrow&) = delete;
+
+  std::string_view view() const { return view_; }
+  mrb_bytes_view bytes() const {
+    return mrb_bytes_view(reinterpret_cast<const std::byte*>(view_.data()), view_.size());
+  }
+  const char* data() const { return view_.data(); }
+  std::size_t size() const { return view_.size(); }
+  mrb_value value() const { return val_; }
+
+private:
+  mrb_state* mrb_;
+  mrb_value val_;
+  std::string_view view_;
+  mrb_pin pin_;
+};
@@ -1,13 +1,382 @@
 #pragma once
 #include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/hash.h>
+#include <mruby/string.h>
+#include <mruby/presym.h>
 #include <any>
+#include <cmath>
+#include <limits>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <utility>
 #include <variant>
+#include "branch_pred.h"
+#include "cpp_type_traits.hpp"
+#include "num_helpers.hpp"
+#include "mrb_string_view.hpp"
+#include "bulk_convert.hpp"
+#include "converter_context.hpp"
+#include "cpp_describe.hpp"
+#include "endian_codec.hpp"
 
-using MapKey = std::variant<mrb_int, mrb_float, std::string>;
+// An Integer as sign and magnitude, what mrb_value_to_any returns for Bigints too big
+// for the native 128 bit types (64 bit ones without __int128). Bigint map keys always
+// use it, equal values give equal keys and Bigints compare by value among themselves.
+struct mrb_big_integer {
+  bool negative = false;
+  // little endian bytes without high zero bytes, up to 15 of them fit the small string buffer
+  std::string magnitude;
 
+  static bool magnitude_less(const std::string& a, const std::string& b) {
+    if (a.size() != b.size()) return a.size() < b.size();
+    for (size_t i = a.size(); i-- > 0;) {
+      if (a[i] != b[i]) return static_cast<unsigned char>(a[i]) < static_cast<unsigned char>(b[i]);
+    }
+    return false;
+  }
+
+  friend bool operator==(const mrb_big_integer& a, const mrb_big_integer& b) {
+    return a.negative == b.negative && a.magnitude == b.magnitude;
+  }
+  friend bool operator<(const mrb_big_integer& a, const mrb_big_integer& b) {
+    if (a.negative != b.negative) return a.negative;
+    return a.negative ? magnitude_less(b.magnitude, a.magnitude) : magnitude_less(a.magnitude, b.magnitude);
+  }
+};
+
+namespace std {
+  template <>
+  struct hash<mrb_big_integer> {
+    size_t operator()(const mrb_big_integer& v) const noexcept {
+      return hash<string>()(v.magnitude) ^ static_cast<size_t>(v.negative);
+    }
+  };
+}
+
+// Magnitude as the native unsigned integer U, false when it doesn't fit
+template <typename U>
+bool mrb_big_integer_magnitude(const mrb_big_integer& v, U& out) {
+  if (v.magnitude.size() > sizeof(U)) return false;
+  out = 0;
+  for (size_t i = v.magnitude.size(); i-- > 0;) {
+    out = static_cast<U>((out << 8) | static_cast<unsigned char>(v.magnitude[i]));
+  }
+  return true;
+}
+
+#ifdef MRB_USE_BIGINT
+// Reads Bigints within 64 bits directly, wider ones are taken apart through one hexadecimal
+// String instead of a decimal one, the public Bigint API has no allocation free way to
+// read their limbs
+MRB_API mrb_big_integer mrb_bint_to_big_integer(mrb_state* mrb, mrb_value bint);
+#endif
+
+using MapKey = std::variant<mrb_int, mrb_float, std::string, mrb_big_integer>;
+
+// std::variant orders by alternative first, which puts every Integer key before every
+// Bigint key. This orders Integer and Bigint keys by value, then Floats, then Strings.
+struct mrb_map_key_less {
+  static int rank(const MapKey& k) {
+    return std::holds_alternative<mrb_float>(k) ? 1 : std::holds_alternative<std::string>(k) ? 2 : 0;
+  }
+
+  bool operator()(const MapKey& a, const MapKey& b) const {
+    int ra = rank(a), rb = rank(b);
+    if (ra != rb) return ra < rb;
+    // a Bigint never holds a value which fits mrb_int, its sign alone decides
+    if (const mrb_big_integer* big = std::get_if<mrb_big_integer>(&a)) {
+      if (std::holds_alternative<mrb_int>(b)) return big->negative;
+    } else if (const mrb_big_integer* other = std::get_if<mrb_big_integer>(&b)) {
+      if (std::holds_alternative<mrb_int>(a)) return !other->negative;
+    }
+    return a < b;
+  }
+};
+
+struct mrb_any_options {
+  // deeper nesting raises an ArgumentError. Converting doesn't recurse, but copying and
+  // destroying the nested std::vector<std::any> result does, once per level, so 0 (unlimited)
+  // lets untrusted input overflow the C stack when the result is released
+  size_t max_depth = 512;
+  // convert objects reachable more than once only once, Arrays, Structs and Sets become
+  // std::shared_ptr<std::vector<std::any>> and Hashes std::shared_ptr<std::map<MapKey, std::any>>
+  bool share = false;
+};
+
+// Cyclic structures raise an ArgumentError
 MRB_API std::any mrb_value_to_any(mrb_state* mrb, mrb_value val);
+MRB_API std::any mrb_value_to_any(mrb_state* mrb, mrb_value val, const mrb_any_options& options);
 MRB_API std::vector<std::any> mrb_array_to_vector(mrb_state* mrb, mrb_value ary);
+// ordered by std::variant: Integer, Float, String and then Bigint keys. mrb_hash_to_sorted_pairs
+// orders the same keys differently, see mrb_map_key_less
 MRB_API std::map<MapKey, std::any> mrb_hash_to_map(mrb_state* mrb, mrb_value hash);
+MRB_API std::unordered_map<MapKey, std::any> mrb_hash_to_unordered_map(mrb_state* mrb, mrb_value hash);
+// insertion ordered, every Hash entry is kept
+MRB_API std::vector<std::pair<MapKey, std::any>> mrb_hash_to_pairs(mrb_state* mrb, mrb_value hash);
+// sorted with mrb_map_key_less for binary search, keys which collapse into the same MapKey keep the first entry like mrb_hash_to_map does
+MRB_API std::vector<std::pair<MapKey, std::any>> mrb_hash_to_sorted_pairs(mrb_state* mrb, mrb_value hash);
+
+namespace mrbcpp::value_converter {
+  template <typename T>
+  struct cpp_converter;
+
+  [[noreturn]] inline void raise_expected(mrb_state* mrb, const char* expected, mrb_value val) {
+    mrb_raisef(mrb, E_TYPE_ERROR, "expected %s, got %s", expected, mrb_obj_classname(mrb, val));
+  }
+
+  // std::is_signed_v is false for __int128 under -std=c++17, only gnu++17 counts it as integral
+  template <typename T>
+  inline constexpr bool is_signed_integral_v = std::is_signed_v<T>
+#if defined(__SIZEOF_INT128__)
+                                               || mrbcpp::number_converter::is_int128<T>::value
+#endif
+                                               ;
+
+  template <typename T>
+  inline constexpr bool is_unsigned_integral_v = std::is_unsigned_v<T>
+#if defined(__SIZEOF_INT128__)
+                                                 || mrbcpp::number_converter::is_uint128<T>::value
+#endif
+                                                 ;
+
+  template <typename T>
+  T to_integral(mrb_state* mrb, mrb_value val) {
+    static_assert(is_signed_integral_v<T> || is_unsigned_integral_v<T>, "expected an integer type");
+    if (likely(mrb_integer_p(val))) {
+      mrb_int i = mrb_integer(val);
+      if constexpr (is_signed_integral_v<T>) {
+        if constexpr (sizeof(T) < sizeof(mrb_int)) {
+          if (unlikely(i < std::numeric_limits<T>::lowest() || i > std::numeric_limits<T>::max())) {
+            mrb_raise(mrb, E_RANGE_ERROR, "Integer out of range for target type");
+          }
+        }
+      } else {
+        if (unlikely(i < 0)) {
+          mrb_raise(mrb, E_RANGE_ERROR, "negative Integer for unsigned target type");
+        }
+        if constexpr (sizeof(T) < sizeof(mrb_int)) {
+          if (unlikely(static_cast<std::make_unsigned_t<mrb_int>>(i) > std::numeric_limits<T>::max())) {
+            mrb_raise(mrb, E_RANGE_ERROR, "Integer out of range for target type");
+          }
+        }
+      }
+      return static_cast<T>(i);
+    }
+#ifdef MRB_USE_BIGINT
+    if (mrb_bigint_p(val)) {
+      if constexpr (sizeof(T) > sizeof(uint64_t)) {
+        using U = mrbcpp::endian::uint_of_size_t<sizeof(T)>;
+        constexpr U sign_bit = static_cast<U>(U(1) << (sizeof(T) * 8 - 1));
+        constexpr bool is_signed = is_signed_integral_v<T>;
+        mrb_big_integer big = mrb_bint_to_big_integer(mrb, val);
+        U mag;
+        if (unlikely(!mrb_big_integer_magnitude(big, mag))) {
+          mrb_raise(mrb, E_RANGE_ERROR, "Integer out of range for target type");
+        }
+        if (big.negative) {
+          if constexpr (!is_signed) mrb_raise(mrb, E_RANGE_ERROR, "negative Integer for unsigned target type");
+          if (unlikely(mag > sign_bit)) mrb_raise(mrb, E_RANGE_ERROR, "Integer out of range for target type");
+          return static_cast<T>(static_cast<U>(U(0) - mag));
+        }
+        if (unlikely(is_signed && mag >= sign_bit)) mrb_raise(mrb, E_RANGE_ERROR, "Integer out of range for target type");
+        return static_cast<T>(mag);
+      } else if constexpr (std::is_unsigned_v<T> && sizeof(T) >= sizeof(uint64_t)) {
+        return static_cast<T>(mrb_bint_as_uint64(mrb, val));
+      } else if constexpr (std::is_signed_v<T> && sizeof(T) >= sizeof(int64_t)) {
+        return static_cast<T>(mrb_bint_as_int64(mrb, val));
+      } else {
+        mrb_raise(mrb, E_RANGE_ERROR, "Integer out of range for target type");
+      }
+    }
+#endif
+    raise_expected(mrb, "Integer", val);
+  }
+
+  template <typename T>
+  T to_floating(mrb_state* mrb, mrb_value val) {
+#ifndef MRB_NO_FLOAT
+    if (likely(mrb_float_p(val))) {
+      mrb_float f = mrb_float(val);
+      if constexpr (std::numeric_limits<T>::max() < std::numeric_limits<mrb_float>::max()) {
+        if (unlikely(std::isfinite(f) && std::fabs(f) > std::numeric_limits<T>::max())) {
+          mrb_raise(mrb, E_RANGE_ERROR, "Float out of range for target type");
+        }
+      }
+      return static_cast<T>(f);
+    }
+#endif
+    if (mrb_integer_p(val)) {
+      return static_cast<T>(mrb_integer(val));
+    }
+    raise_expected(mrb, "Float", val);
+  }
+
+  template <typename T>
+  struct cpp_converter {
+    static T convert(mrb_state* mrb, mrb_value val) {
+      if constexpr (std::is_same_v<T, mrb_value>) {
+        return val;
+      } else if constexpr (std::is_same_v<T, bool>) {
+        if (mrb_true_p(val)) return true;
+        if (mrb_false_p(val)) return false;
+        raise_expected(mrb, "true or false", val);
+      } else if constexpr (std::is_enum_v<T>) {
+        return static_cast<T>(cpp_converter<std::underlying_type_t<T>>::convert(mrb, val));
+      } else if constexpr (std::is_floating_point_v<T>) {
+        return to_floating<T>(mrb, val);
+      } else if constexpr (std::is_integral_v<T>
+#if defined(__SIZEOF_INT128__)
+                           || mrbcpp::number_converter::is_int128<T>::value
+                           || mrbcpp::number_converter::is_uint128<T>::value
+#endif
+                           ) {
+        return to_integral<T>(mrb, val);
+      } else if constexpr (std::is_same_v<T, std::string_view>) {
+        // borrows from the String, see mrb_string_view.hpp for lifetime rules. Symbol names
+        // may live in a scratch buffer which the next lookup overwrites, so they are refused
+        if (unlikely(!mrb_string_p(val))) raise_expected(mrb, "String", val);
+        return mrb_str_view(mrb, val);
+      } else if constexpr (std::is_same_v<T, std::string>) {
+        if (unlikely(!mrb_string_p(val) && !mrb_symbol_p(val))) raise_expected(mrb, "String", val);
+        return T(mrb_str_view(mrb, val));
+      } else if constexpr (std::is_same_v<T, mrb_bytes_view>) {
+        if (unlikely(!mrb_string_p(val))) raise_expected(mrb, "String", val);
+        return mrb_str_bytes(mrb, val);
+      } else if constexpr (std::is_same_v<T, std::nullptr_t>) {
+        if (!mrb_nil_p(val)) raise_expected(mrb, "nil", val);
+        return nullptr;
+      } else if constexpr (is_optional_v<T>) {
+        if (mrb_nil_p(val)) return std::nullopt;
+        return cpp_converter<typename T::value_type>::convert(mrb, val);
+      } else if constexpr (is_described_v<T>) {
+        // instances of the generated Struct class are read by index, Hashes by Symbol key
+        constexpr std::size_t n = described_size_v<T>;
+        const mrb_described_struct* desc = described_struct<T>(mrb);
+        bool by_index = mrb_type(val) == MRB_TT_STRUCT && mrb_obj_is_kind_of(mrb, val, desc->cls)
+                        && RARRAY_LEN(val) >= static_cast<mrb_int>(n);
+        if (unlikely(!by_index && !mrb_hash_p(val))) raise_expected(mrb, "Struct or Hash", val);
+        T out{};
+        std::apply([&](auto... member) {
+          std::size_t i = 0;
+          ((out.*member = cpp_converter<std::remove_reference_t<decltype(out.*member)>>::convert(mrb,
+              by_index ? RARRAY_PTR(val)[i] : mrb_hash_get(mrb, val, mrb_symbol_value(desc->members[i]))), ++i), ...);
+        }, mrb_cpp_describe<T>::members);
+        return out;
+      } else if constexpr (is_map_like_v<T>) {
+        if (unlikely(!mrb_hash_p(val))) raise_expected(mrb, "Hash", val);
+        T out;
+        if constexpr (has_reserve_v<T>) {
+          out.reserve(static_cast<size_t>(mrb_hash_size(mrb, val)));
+        }
+        mrb_hash_foreach(mrb, mrb_hash_ptr(val), [](mrb_state* mrb, mrb_value k, mrb_value v, void* data) -> int {
+          static_cast<T*>(data)->emplace(
+            cpp_converter<typename T::key_type>::convert(mrb, k),
+            cpp_converter<typename T::mapped_type>::convert(mrb, v));
+          return 0;
+        }, &out);
+        return out;
+      } else if constexpr (is_set_like_v<T>) {
+        mrb_value ary = val;
+        if (!mrb_array_p(val)) {
+#ifdef MRB_USE_SET
+          if (unlikely(mrb_type(val) != MRB_TT_SET)) raise_expected(mrb, "Set or Array", val);
+#else
+          if (unlikely(!mrb_obj_is_kind_of(mrb, val, mrb_converter_set_class(mrb)))) raise_expected(mrb, "Set or Array", val);
+#endif
+          ary = mrb_funcall_id(mrb, val, MRB_SYM(to_a), 0);
+        }
+        T out;
+        if constexpr (has_reserve_v<T>) {
+          out.reserve(static_cast<size_t>(RARRAY_LEN(ary)));
+        }
+        for (mrb_int i = 0; i < RARRAY_LEN(ary); ++i) {
+          out.insert(cpp_converter<typename T::value_type>::convert(mrb, RARRAY_PTR(ary)[i]));
+        }
+        return out;
+      } else if constexpr (is_std_array_v<T>) {
+        if (unlikely(!mrb_array_p(val))) raise_expected(mrb, "Array", val);
+        if (unlikely(RARRAY_LEN(val) != static_cast<mrb_int>(std::tuple_size_v<T>))) {
+          mrb_raisef(mrb, E_ARGUMENT_ERROR, "expected Array of %d elements", static_cast<int>(std::tuple_size_v<T>));
+        }
+        T out;
+        for (size_t i = 0; i < std::tuple_size_v<T>; ++i) {
+          out[i] = cpp_converter<typename T::value_type>::convert(mrb, RARRAY_PTR(val)[i]);
+        }
+        return out;
+      } else if constexpr (is_sequence_like_v<T> && is_pair_v<typename T::value_type>) {
+        // vector<pair<K, V>> keeps the Hash insertion order
+        if (unlikely(!mrb_hash_p(val))) raise_expected(mrb, "Hash", val);
+        using P = typename T::value_type;
+        T out;
+        if constexpr (has_reserve_v<T>) {
+          out.reserve(static_cast<size_t>(mrb_hash_size(mrb, val)));
+        }
+        mrb_hash_foreach(mrb, mrb_hash_ptr(val), [](mrb_state* mrb, mrb_value k, mrb_value v, void* data) -> int {
+          static_cast<T*>(data)->emplace_back(
+            cpp_converter<std::remove_cv_t<typename P::first_type>>::convert(mrb, k),
+            cpp_converter<typename P::second_type>::convert(mrb, v));
+          return 0;
+        }, &out);
+        return out;
+      } else if constexpr (is_contiguous_arithmetic_v<T> && is_sequence_like_v<T>) {
+        // vector<number>: size once, then write straight into the buffer
+        switch (mrb_type(val)) {
+          case MRB_TT_ARRAY:
+          case MRB_TT_STRUCT:
+            break;
+          default: raise_expected(mrb, "Array", val);
+        }
+        using V = typename T::value_type;
+        mrb_int len = RARRAY_LEN(val);
+        const mrb_value* src = RARRAY_PTR(val);
+        T out(static_cast<size_t>(len));
+        V* dst = out.data();
+        for (mrb_int i = 0; i < len; ++i) {
+          if constexpr (std::is_integral_v<V>) {
+            dst[i] = to_integral<V>(mrb, src[i]);
+          } else {
+            dst[i] = to_floating<V>(mrb, src[i]);
+          }
+        }
+        return out;
+      } else if constexpr (is_sequence_like_v<T>) {
+        switch (mrb_type(val)) {
+          case MRB_TT_ARRAY:
+          case MRB_TT_STRUCT:
+            break;
+          default: raise_expected(mrb, "Array", val);
+        }
+        T out;
+        if constexpr (has_reserve_v<T>) {
+          out.reserve(static_cast<size_t>(RARRAY_LEN(val)));
+        }
+        for (mrb_int i = 0; i < RARRAY_LEN(val); ++i) {
+          out.push_back(cpp_converter<typename T::value_type>::convert(mrb, RARRAY_PTR(val)[i]));
+        }
+        return out;
+      } else if constexpr (is_time_point_v<T>) {
+        static_assert(std::is_same_v<typename T::clock, std::chrono::system_clock>,
+          "only system_clock time_points can be converted from Time");
+        using namespace std::chrono;
+
+        if (unlikely(!mrb_obj_is_kind_of(mrb, val, mrb_converter_time_class(mrb)))) raise_expected(mrb, "Time", val);
+        int64_t sec = to_integral<int64_t>(mrb, mrb_funcall_id(mrb, val, MRB_SYM(to_i), 0));
+        int64_t usec = to_integral<int64_t>(mrb, mrb_funcall_id(mrb, val, MRB_SYM(usec), 0));
+        return time_point_cast<typename T::duration>(system_clock::time_point(
+          duration_cast<system_clock::duration>(seconds(sec) + microseconds(usec))));
+      } else {
+        static_assert(sizeof(T) == 0, "Type not supported by cpp_converter");
+      }
+    }
+  };
+}
+
+template <typename T>
+T mrb_value_to_cpp(mrb_state* mrb, mrb_value val) {
+  return mrbcpp::value_converter::cpp_converter<std::remove_cv_t<std::remove_reference_t<T>>>::convert(mrb, val);
+}
@@ -0,0 +1,228 @@
+#pragma once
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/hash.h>
+#include <mruby/string.h>
+#include <mruby/presym.h>
+#include <mruby/error.h>
+#include <cstddef>
+#include <string_view>
+#include <unordered_set>
+#include "branch_pred.h"
+#include "mrb_string_view.hpp"
+
+// Streams an mruby value tree into a visitor, depth first, without building C++ containers.
+// Derive from mrb_value_visitor<YourVisitor> and override the callbacks you need,
+// the defaults forward to the more general callback or do nothing.
+//
+//   nil, true/false, Integer, Float  -> on_nil, on_bool, on_int, on_float
+//   String, Symbol, Bigint           -> on_string, on_symbol, on_bigint (decimal digits)
+//   Array, Struct, Set               -> begin_array(len) / begin_struct(len) / begin_set(len), the elements, end_*
+//   Hash                             -> begin_map(len), per entry the key and the value, end_map
+//
+// String and Symbol keys are reported through key(string_view), every other key is
+// visited like a value between begin_key() and end_key().
+// string_views are only valid during the callback, Symbol names are backed by a String
+// for it, mruby may hand out inline Symbol names from a buffer the next lookup overwrites.
+//
+// Containers being visited are tracked, a cyclic structure raises an ArgumentError and
+// so does nesting deeper than max_depth (0 for unlimited), the visit recurses on the C stack.
+template <typename Derived>
+struct mrb_value_visitor {
+  void on_nil() {}
+  void on_bool(bool) {}
+  void on_int(mrb_int) {}
+  void on_float(mrb_float) {}
+  void on_string(std::string_view) {}
+  void on_symbol(std::string_view s) { self().on_string(s); }
+  void on_bigint(std::string_view digits) { self().on_string(digits); }
+
+  void begin_array(mrb_int) {}
+  void end_array() {}
+  void begin_struct(mrb_int len) { self().begin_array(len); }
+  void end_struct() { self().end_array(); }
+  void begin_set(mrb_int len) { self().begin_array(len); }
+  void end_set() { self().end_array(); }
+
+  void begin_map(mrb_int) {}
+  void key(std::string_view k) { self().on_string(k); }
+  void begin_key() {}
+  void end_key() {}
+  void end_map() {}
+
+private:
+  Derived& self() { return static_cast<Derived&>(*this); }
+};
+
+namespace mrbcpp::value_converter {
+  struct visit_guard {
+    std::size_t max_depth;
+    std::size_t depth = 0;
+    std::unordered_set<struct RBasic*> active;
+  };
+
+  // Strings as they are, Symbols through their name as a String
+  inline mrb_value name_of(mrb_state* mrb, mrb_value val) {
+    return mrb_symbol_p(val) ? mrb_sym_str(mrb, mrb_symbol(val)) : val;
+  }
+
+  // Keeps a container reachable and marked as active while its elements are visited,
+  // callbacks and Set#to_a may run ruby code which drops every other reference to it
+  class container_scope {
+  public:
+    container_scope(mrb_state* mrb, mrb_value val, visit_guard& guard)
+    : mrb_(mrb), obj_(mrb_basic_ptr(val)), guard_(guard), arena_index_(mrb_gc_arena_save(mrb)) {
+      if (unlikely(guard.max_depth && guard.depth >= guard.max_depth)) {
+        mrb_raise(mrb, E_ARGUMENT_ERROR, "nesting too deep");
+      }
+      if (unlikely(!guard.active.insert(obj_).second)) {
+        mrb_raise(mrb, E_ARGUMENT_ERROR, "cyclic structure cannot be visited");
+      }
+      mrb_gc_protect(mrb, val);
+      guard.depth++;
+    }
+
+    ~container_scope() {
+      guard_.depth--;
+      guard_.active.erase(obj_);
+      mrb_gc_arena_restore(mrb_, arena_index_);
+    }
+
+    container_scope(const container_scope&) = delete;
+    container_scope& operator=(const container_scope&) = delete;
+
+  private:
+    mrb_state* mrb_;
+    struct RBasic* obj_;
+    visit_guard& guard_;
+    int arena_index_;
+  };
+
+  template <typename Visitor>
+  void visit_elements(mrb_state* mrb, mrb_value ary, Visitor& visitor, visit_guard& guard);
+
+  template <typename Visitor>
+  void visit_value(mrb_state* mrb, mrb_value val, Visitor& visitor, visit_guard& guard) {
+    switch (mrb_type(val)) {
+      case MRB_TT_FALSE:
+        if (mrb_nil_p(val)) visitor.on_nil(); else visitor.on_bool(false);
+        return;
+      case MRB_TT_TRUE:
+        visitor.on_bool(true);
+        return;
+      case MRB_TT_UNDEF:
+      case MRB_TT_FREE:
+        visitor.on_nil();
+        return;
+      case MRB_TT_INTEGER:
+        visitor.on_int(mrb_integer(val));
+        return;
+#ifndef MRB_NO_FLOAT
+      case MRB_TT_FLOAT:
+        visitor.on_float(mrb_float(val));
+        return;
+#endif
+      case MRB_TT_SYMBOL: {
+        int arena_index = mrb_gc_arena_save(mrb);
+        visitor.on_symbol(mrb_str_view(mrb, name_of(mrb, val)));
+        mrb_gc_arena_restore(mrb, arena_index);
+        return;
+      }
+      case MRB_TT_STRING:
+        visitor.on_string(mrb_str_view(mrb, val));
+        return;
+#ifdef MRB_USE_BIGINT
+      case MRB_TT_BIGINT: {
+        int arena_index = mrb_gc_arena_save(mrb);
+        visitor.on_bigint(mrb_str_view(mrb, mrb_integer_to_str(mrb, val, 10)));
+        mrb_gc_arena_restore(mrb, arena_index);
+        return;
+      }
+#endif
+      case MRB_TT_ARRAY: {
+        container_scope scope(mrb, val, guard);
+        visitor.begin_array(RARRAY_LEN(val));
+        visit_elements(mrb, val, visitor, guard);
+        visitor.end_array();
+        return;
+      }
+      case MRB_TT_STRUCT: {
+        container_scope scope(mrb, val, guard);
+        visitor.begin_struct(RARRAY_LEN(val));
+        visit_elements(mrb, val, visitor, guard);
+        visitor.end_struct();
+        return;
+      }
+#ifdef MRB_USE_SET
+      case MRB_TT_SET: {
+        container_scope scope(mrb, val, guard);
+        mrb_value ary = mrb_funcall_id(mrb, val, MRB_SYM(to_a), 0);
+        visitor.begin_set(RARRAY_LEN(ary));
+        visit_elements(mrb, ary, visitor, guard);
+        visitor.end_set();
+        return;
+      }
+#endif
+      case MRB_TT_HASH: {
+        container_scope scope(mrb, val, guard);
+        struct entry_visit {
+          Visitor& visitor;
+          visit_guard& guard;
+        } ctx{visitor, guard};
+        visitor.begin_map(mrb_hash_size(mrb, val));
+        mrb_hash_foreach(mrb, mrb_hash_ptr(val), [](mrb_state* mrb, mrb_value k, mrb_value v, void* data) -> int {
+          entry_visit& ctx = *static_cast<entry_visit*>(data);
+          if (mrb_string_p(k) || mrb_symbol_p(k)) {
+            int arena_index = mrb_gc_arena_save(mrb);
+            ctx.visitor.key(mrb_str_view(mrb, name_of(mrb, k)));
+            mrb_gc_arena_restore(mrb, arena_index);
+          } else {
+            ctx.visitor.begin_key();
+            visit_value(mrb, k, ctx.visitor, ctx.guard);
+            ctx.visitor.end_key();
+          }
+          visit_value(mrb, v, ctx.visitor, ctx.guard);
+          return 0;
+        }, &ctx);
+        visitor.end_map();
+        return;
+      }
+      default:
+        mrb_raise(mrb, E_TYPE_ERROR, "Unsupported or unhandled mrb_value type");
+    }
+  }
+
+  template <typename Visitor>
+  void visit_elements(mrb_state* mrb, mrb_value ary, Visitor& visitor, visit_guard& guard) {
+    // re-read the length, a callback may have shrunk the Array
+    for (mrb_int i = 0; i < RARRAY_LEN(ary); ++i) {
+      visit_value(mrb, RARRAY_PTR(ary)[i], visitor, guard);
+    }
+  }
+
+  // The guard lives in the frame of mrb_value_visit and the visit runs under
+  // mrb_protect_error, errors are raised again once the guard is destroyed
+  template <typename Visitor>
+  struct visit_call {
+    mrb_value val;
+    Visitor& visitor;
+    visit_guard guard;
+
+    static mrb_value run(mrb_state* mrb, void* data) {
+      visit_call& call = *static_cast<visit_call*>(data);
+      visit_value(mrb, call.val, call.visitor, call.guard);
+      return mrb_nil_value();
+    }
+  };
+}
+
+template <typename Visitor>
+void mrb_value_visit(mrb_state* mrb, mrb_value val, Visitor& visitor, std::size_t max_depth = 512) {
+  mrb_bool failed;
+  mrb_value error;
+  {
+    mrbcpp::value_converter::visit_call<Visitor> call{val, visitor, {max_depth}};
+    error = mrb_protect_error(mrb, mrbcpp::value_converter::visit_call<Visitor>::run, &call, &failed);
+  }
+  if (unlikely(failed)) mrb_exc_raise(mrb, error);
+}
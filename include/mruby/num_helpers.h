@@ -50,6 +50,76 @@ MRB_API mrb_value MRB_DECODE_FIX_LE(mrb_state *mrb, mrb_value bin);
 MRB_API mrb_value MRB_ENCODE_FIX_BE(mrb_state *mrb, mrb_int numeric);
 MRB_API mrb_value MRB_DECODE_FIX_BE(mrb_state *mrb, mrb_value bin);
 
+typedef enum mrb_num_type {
+  MRB_NUM_I8, MRB_NUM_U8,
+  MRB_NUM_I16, MRB_NUM_U16,
+  MRB_NUM_I32, MRB_NUM_U32,
+  MRB_NUM_I64, MRB_NUM_U64,
+  MRB_NUM_F32, MRB_NUM_F64,
+  MRB_NUM_I128, MRB_NUM_U128
+} mrb_num_type;
+
+typedef enum mrb_byte_order {
+  MRB_BYTE_ORDER_LE,
+  MRB_BYTE_ORDER_BE
+} mrb_byte_order;
+
+/* :i8, :u8 ... :u64, :f32, :f64, :i128, :u128 */
+MRB_API mrb_num_type mrb_num_type_from_sym(mrb_state *mrb, mrb_sym type);
+/* :le or :little, :be or :big, :native */
+MRB_API mrb_byte_order mrb_byte_order_from_sym(mrb_state *mrb, mrb_sym order);
+MRB_API size_t mrb_num_type_width(mrb_num_type type);
+/* one Integer or Float -> binary String of the width of type */
+MRB_API mrb_value mrb_encode_number(mrb_state *mrb, mrb_value num, mrb_num_type type, mrb_byte_order order);
+/* binary String of exactly the width of type -> Integer or Float */
+MRB_API mrb_value mrb_decode_number(mrb_state *mrb, mrb_value bin, mrb_num_type type, mrb_byte_order order);
+/* Array of numbers -> one binary String, 128 bit types are only supported by mrb_encode_number/mrb_decode_number */
+MRB_API mrb_value mrb_pack_numbers(mrb_state *mrb, mrb_value ary, mrb_num_type type, mrb_byte_order order);
+/* binary String -> Array of numbers, the String length must be a multiple of the element width */
+MRB_API mrb_value mrb_unpack_numbers(mrb_state *mrb, mrb_value bin, mrb_num_type type, mrb_byte_order order);
+/* reverses the bytes of count elements of width 1, 2, 4, 8 or 16 in place,
+   returns FALSE without touching buf for any other width */
+MRB_API mrb_bool mrb_bswap_buffer(void *buf, size_t count, size_t width);
+
+/* LEB128 varints, a uint64_t takes at most MRB_VARINT_MAX_LEN bytes */
+#define MRB_VARINT_MAX_LEN 10
+
+/* writes value to buf, which must have room for MRB_VARINT_MAX_LEN bytes, returns the bytes written */
+MRB_API size_t mrb_varint_encode(uint64_t value, uint8_t *buf);
+/* reads one varint from buf, returns the bytes consumed or 0 when buf is truncated or the varint is overlong */
+MRB_API size_t mrb_varint_decode(const uint8_t *buf, size_t len, uint64_t *value);
+/* the value an Integer is encoded as, zigzag mapped or, without zigzag, negative numbers as
+   their 64 bit two's complement like protobuf's int64, which takes 10 bytes */
+MRB_API uint64_t mrb_varint_value(mrb_state *mrb, mrb_value num, mrb_bool zigzag);
+/* Integer -> varint String, see mrb_varint_value */
+MRB_API mrb_value mrb_varint_pack(mrb_state *mrb, mrb_value num, mrb_bool zigzag);
+/* String of varints -> Array of Integers */
+MRB_API mrb_value mrb_varint_unpack(mrb_state *mrb, mrb_value bin, mrb_bool zigzag);
+
+MRB_INLINE uint64_t
+mrb_zigzag_encode(int64_t value)
+{
+  return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+MRB_INLINE int64_t
+mrb_zigzag_decode(uint64_t value)
+{
+  return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+/* treats len bytes of buf as one unsigned number in the given byte order and adds or
+   subtracts by in place, returns TRUE when the result wrapped around */
+MRB_API mrb_bool mrb_bytes_add(uint8_t *buf, size_t len, uint64_t by, mrb_byte_order order);
+MRB_API mrb_bool mrb_bytes_sub(uint8_t *buf, size_t len, uint64_t by, mrb_byte_order order);
+
+#ifdef MRB_USE_BIGINT
+/* Integer with the magnitude stored in len bytes of buf, returns a plain Integer when the
+   value fits. The bytes are written out as hex digits and parsed by mrb_bint_new_str, not
+   copied in as limbs, the digits need a malloc'ed scratch buffer above 64 bytes */
+MRB_API mrb_value mrb_bint_new_bytes(mrb_state *mrb, const uint8_t *buf, size_t len, mrb_bool negative, mrb_byte_order order);
+#endif
+
 #ifndef MRB_NO_FLOAT
 MRB_API mrb_value MRB_ENCODE_FLO_NAT(mrb_state *mrb, mrb_float numeric);
 MRB_API mrb_value MRB_DECODE_FLO_NAT(mrb_state *mrb, mrb_value bin);
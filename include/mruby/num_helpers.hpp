@@ -1,4 +1,5 @@
 #pragma once
+#include <cmath>
 #include <type_traits>
 #include <limits>
 #include <cstdint>
@@ -40,40 +41,42 @@ namespace mrbcpp::number_converter {
 #endif
 
 
+#ifdef MRB_USE_BIGINT
+  // Writes the 16 hex digits of limb in front of end, returns where they start
+  static inline char* mrb_bint_hex_limb(char* end, uint64_t limb) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < 16; ++i) {
+      *--end = digits[limb & 0xf];
+      limb >>= 4;
+    }
+    return end;
+  }
+
+  // One Bigint from the two 64 bit halves of its magnitude, written out as hex digits on
+  // the stack and parsed by mrb_bint_new_str, a negative base gives a negative number.
+  static inline mrb_value mrb_bint_new_limbs(mrb_state* mrb, uint64_t hi, uint64_t lo, bool negative) {
+    char buf[32];
+    char* end = buf + sizeof(buf);
+    char* p = mrb_bint_hex_limb(mrb_bint_hex_limb(end, lo), hi);
+    while (p < end - 1 && *p == '0') ++p;
+    return mrb_bint_new_str(mrb, p, static_cast<mrb_int>(end - p), negative ? -16 : 16);
+  }
+#endif
+
 #if defined(__SIZEOF_INT128__) && defined(MRB_USE_BIGINT)
   static inline mrb_value mrb_bint_new_uint128(mrb_state* mrb, unsigned __int128 u) {
-    int idx = mrb_gc_arena_save(mrb);
     uint64_t lo = static_cast<uint64_t>(u);
     uint64_t hi = static_cast<uint64_t>(u >> 64);
-
-    mrb_value v_lo = mrb_bint_new_uint64(mrb, lo);
-    if (hi == 0) {
-      mrb_gc_arena_restore(mrb, idx);
-      mrb_gc_protect(mrb, v_lo);
-      return v_lo;
-    }
-    mrb_gc_protect(mrb, v_lo);
-
-    mrb_value v_hi = mrb_bint_new_uint64(mrb, hi);
-    mrb_gc_protect(mrb, v_hi);
-    mrb_value v_hi_shift = mrb_bint_lshift(mrb, v_hi, 64);
-    mrb_gc_protect(mrb, v_hi_shift);
-    mrb_value res = mrb_bint_add(mrb, v_hi_shift, v_lo);
-    mrb_gc_arena_restore(mrb, idx);
-    mrb_gc_protect(mrb, res);
-    return res;
+    if (hi == 0) return mrb_bint_new_uint64(mrb, lo);
+    return mrb_bint_new_limbs(mrb, hi, lo, false);
   }
 
   static inline mrb_value mrb_bint_new_int128(mrb_state* mrb, __int128 s) {
-    int idx = mrb_gc_arena_save(mrb);
     bool neg = s < 0;
-    unsigned __int128 mag = neg ? static_cast<unsigned __int128>(-s)
+    // negating in unsigned arithmetic keeps the most negative value intact
+    unsigned __int128 mag = neg ? 0 - static_cast<unsigned __int128>(s)
                                 : static_cast<unsigned __int128>(s);
-    mrb_value v = mrb_bint_new_uint128(mrb, mag);
-    mrb_value res =  neg ? mrb_bint_neg(mrb, v) : v;
-    mrb_gc_arena_restore(mrb, idx);
-    mrb_gc_protect(mrb, res);
-    return res;
+    return mrb_bint_new_limbs(mrb, static_cast<uint64_t>(mag >> 64), static_cast<uint64_t>(mag), neg);
   }
 #endif
 }
@@ -100,7 +103,7 @@ if constexpr (std::numeric_limits<T>::lowest() >= std::numeric_limits<mrb_float>
       return mrb_float_value(mrb, static_cast<mrb_float>(value));
     } else {
       // Type doesn't fit statically, check runtime value
-      if (isfinite(value) &&
+      if (std::isfinite(value) &&
           value >= std::numeric_limits<mrb_float>::lowest() &&
           value <= std::numeric_limits<mrb_float>::max()) {
         return mrb_float_value(mrb, static_cast<mrb_float>(value));
@@ -0,0 +1,166 @@
+#include <mruby.h>
+#include <mruby/class.h>
+#include <mruby/data.h>
+#include <mruby/string.h>
+#include <mruby/variable.h>
+#include <mruby/presym.h>
+#include <mruby/num_helpers.h>
+#include <mruby/cpp_helpers.hpp>
+#include <mruby/endian_codec.hpp>
+#include <mruby/num_helpers.hpp>
+
+namespace {
+  using mrbcpp::endian::order;
+
+  // A read cursor over a String, the String itself is kept alive through an
+  // instance variable of the reader, so only its bytes are looked at here.
+  struct BinaryReader {
+    mrb_value buffer;
+    mrb_int pos = 0;
+
+    explicit BinaryReader(mrb_value buf) : buffer(buf) {}
+
+    const char* take(mrb_state* mrb, mrb_int n) {
+      if (unlikely(n < 0)) mrb_raise(mrb, E_ARGUMENT_ERROR, "negative length");
+      if (unlikely(n > RSTRING_LEN(buffer) - pos)) {
+        mrb_raisef(mrb, E_RANGE_ERROR, "read of %d bytes at offset %d exceeds buffer size of %d bytes",
+                   static_cast<int>(n), static_cast<int>(pos), static_cast<int>(RSTRING_LEN(buffer)));
+      }
+      const char* p = RSTRING_PTR(buffer) + pos;
+      pos += n;
+      return p;
+    }
+  };
+}
+
+MRB_CPP_DEFINE_POOLED_TYPE(BinaryReader, binary_reader)
+
+namespace {
+  BinaryReader* get_reader(mrb_state* mrb, mrb_value self) {
+    BinaryReader* reader = mrb_cpp_get<BinaryReader>(mrb, self);
+    if (unlikely(!reader)) mrb_raise(mrb, E_RUNTIME_ERROR, "uninitialized BinaryReader");
+    return reader;
+  }
+
+  mrb_value reader_initialize(mrb_state* mrb, mrb_value self) {
+    mrb_value buf;
+    mrb_get_args(mrb, "S", &buf);
+
+    if (BinaryReader* old = static_cast<BinaryReader*>(DATA_PTR(self))) {
+      mrb_cpp_delete(mrb, old);
+      DATA_PTR(self) = nullptr;
+    }
+    mrb_iv_set(mrb, self, MRB_SYM(buffer), buf);
+    mrb_cpp_new<BinaryReader>(mrb, self, buf);
+
+    return self;
+  }
+
+  template <typename T, order O>
+  mrb_value reader_read(mrb_state* mrb, mrb_value self) {
+    BinaryReader* reader = get_reader(mrb, self);
+    return mrb_convert_number(mrb, mrbcpp::endian::decode<T, O>(reader->take(mrb, sizeof(T))));
+  }
+
+  mrb_value reader_read_varint(mrb_state* mrb, mrb_value self) {
+    mrb_bool zigzag = FALSE;
+    mrb_get_args(mrb, "|b", &zigzag);
+    BinaryReader* reader = get_reader(mrb, self);
+
+    mrb_int avail = RSTRING_LEN(reader->buffer) - reader->pos;
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(RSTRING_PTR(reader->buffer)) + reader->pos;
+    uint64_t v;
+    size_t used = avail > 0 ? mrb_varint_decode(p, static_cast<size_t>(avail), &v) : 0;
+    if (unlikely(used == 0)) {
+      // running out of bytes is a read past the end like any other, a malformed varint is not
+      bool terminated = false;
+      for (mrb_int i = 0; i < avail && i < MRB_VARINT_MAX_LEN; ++i) {
+        if (!(p[i] & 0x80)) { terminated = true; break; }
+      }
+      if (!terminated && avail < MRB_VARINT_MAX_LEN) {
+        mrb_raisef(mrb, E_RANGE_ERROR, "truncated varint at offset %d", static_cast<int>(reader->pos));
+      }
+      mrb_raise(mrb, E_ARGUMENT_ERROR, "overlong varint");
+    }
+    reader->pos += static_cast<mrb_int>(used);
+
+    return zigzag ? mrb_convert_number(mrb, mrb_zigzag_decode(v)) : mrb_convert_number(mrb, v);
+  }
+
+  mrb_value reader_read_bytes(mrb_state* mrb, mrb_value self) {
+    mrb_int n;
+    mrb_get_args(mrb, "i", &n);
+    BinaryReader* reader = get_reader(mrb, self);
+    const char* p = reader->take(mrb, n);
+    return mrb_str_new(mrb, p, static_cast<size_t>(n));
+  }
+
+  mrb_value reader_skip(mrb_state* mrb, mrb_value self) {
+    mrb_int n;
+    mrb_get_args(mrb, "i", &n);
+    get_reader(mrb, self)->take(mrb, n);
+    return self;
+  }
+
+  mrb_value reader_pos(mrb_state* mrb, mrb_value self) {
+    return mrb_int_value(mrb, get_reader(mrb, self)->pos);
+  }
+
+  mrb_value reader_set_pos(mrb_state* mrb, mrb_value self) {
+    mrb_int pos;
+    mrb_get_args(mrb, "i", &pos);
+    BinaryReader* reader = get_reader(mrb, self);
+    if (unlikely(pos < 0 || pos > RSTRING_LEN(reader->buffer))) {
+      mrb_raisef(mrb, E_RANGE_ERROR, "offset %d outside of buffer", static_cast<int>(pos));
+    }
+    reader->pos = pos;
+    return mrb_int_value(mrb, pos);
+  }
+
+  mrb_value reader_remaining(mrb_state* mrb, mrb_value self) {
+    BinaryReader* reader = get_reader(mrb, self);
+    return mrb_int_value(mrb, RSTRING_LEN(reader->buffer) - reader->pos);
+  }
+
+  mrb_value reader_eof(mrb_state* mrb, mrb_value self) {
+    BinaryReader* reader = get_reader(mrb, self);
+    return mrb_bool_value(reader->pos >= RSTRING_LEN(reader->buffer));
+  }
+
+  template <typename T>
+  void define_readers(mrb_state* mrb, struct RClass* cls, const char* le, const char* be) {
+    mrb_define_method(mrb, cls, le, reader_read<T, order::little>, MRB_ARGS_NONE());
+    mrb_define_method(mrb, cls, be, reader_read<T, order::big>, MRB_ARGS_NONE());
+  }
+}
+
+MRB_BEGIN_DECL
+void
+mrb_c_ext_helpers_binary_reader_init(mrb_state* mrb)
+{
+  struct RClass* mod = mrb_define_module(mrb, "CExtHelpers");
+  struct RClass* cls = mrb_define_class_under(mrb, mod, "BinaryReader", mrb->object_class);
+  MRB_SET_INSTANCE_TT(cls, MRB_TT_DATA);
+
+  mrb_define_method(mrb, cls, "initialize", reader_initialize, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, cls, "read_u8", reader_read<uint8_t, order::native>, MRB_ARGS_NONE());
+  mrb_define_method(mrb, cls, "read_i8", reader_read<int8_t, order::native>, MRB_ARGS_NONE());
+  define_readers<uint16_t>(mrb, cls, "read_u16_le", "read_u16_be");
+  define_readers<int16_t>(mrb, cls, "read_i16_le", "read_i16_be");
+  define_readers<uint32_t>(mrb, cls, "read_u32_le", "read_u32_be");
+  define_readers<int32_t>(mrb, cls, "read_i32_le", "read_i32_be");
+  define_readers<uint64_t>(mrb, cls, "read_u64_le", "read_u64_be");
+  define_readers<int64_t>(mrb, cls, "read_i64_le", "read_i64_be");
+#ifndef MRB_NO_FLOAT
+  define_readers<float>(mrb, cls, "read_f32_le", "read_f32_be");
+  define_readers<double>(mrb, cls, "read_f64_le", "read_f64_be");
+#endif
+  mrb_define_method(mrb, cls, "read_varint", reader_read_varint, MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, cls, "read_bytes", reader_read_bytes, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, cls, "skip", reader_skip, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, cls, "pos", reader_pos, MRB_ARGS_NONE());
+  mrb_define_method(mrb, cls, "pos=", reader_set_pos, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, cls, "remaining", reader_remaining, MRB_ARGS_NONE());
+  mrb_define_method(mrb, cls, "eof?", reader_eof, MRB_ARGS_NONE());
+}
+MRB_END_DECL
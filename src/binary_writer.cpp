@@ -0,0 +1,143 @@
+#include <mruby.h>
+#include <mruby/class.h>
+#include <mruby/data.h>
+#include <mruby/string.h>
+#include <mruby/variable.h>
+#include <mruby/presym.h>
+#include <mruby/num_helpers.h>
+#include <mruby/cpp_helpers.hpp>
+#include <mruby/endian_codec.hpp>
+#include <mruby/mrb_value_to_cpp.hpp>
+
+namespace {
+  using mrbcpp::endian::order;
+
+  // Appends to a String which is kept alive through an instance variable of the writer.
+  // mrb_str_cat grows the String capacity geometrically, so a run of small writes
+  // costs amortised O(1) each and never creates temporary Strings.
+  struct BinaryWriter {
+    mrb_value buffer;
+
+    explicit BinaryWriter(mrb_value buf) : buffer(buf) {}
+
+    void append(mrb_state* mrb, const void* p, size_t n) {
+      mrb_str_cat(mrb, buffer, static_cast<const char*>(p), n);
+    }
+  };
+}
+
+MRB_CPP_DEFINE_TYPE(BinaryWriter, binary_writer)
+
+namespace {
+  BinaryWriter* get_writer(mrb_state* mrb, mrb_value self) {
+    BinaryWriter* writer = mrb_cpp_get<BinaryWriter>(mrb, self);
+    if (unlikely(!writer)) mrb_raise(mrb, E_RUNTIME_ERROR, "uninitialized BinaryWriter");
+    return writer;
+  }
+
+  mrb_value new_buffer(mrb_state* mrb, mrb_value self, mrb_int capa) {
+    mrb_value buf = mrb_str_new_capa(mrb, static_cast<size_t>(capa));
+    mrb_iv_set(mrb, self, MRB_SYM(buffer), buf);
+    return buf;
+  }
+
+  mrb_value writer_initialize(mrb_state* mrb, mrb_value self) {
+    mrb_int capa = 0;
+    mrb_get_args(mrb, "|i", &capa);
+    if (unlikely(capa < 0)) mrb_raise(mrb, E_ARGUMENT_ERROR, "negative capacity");
+
+    if (BinaryWriter* old = static_cast<BinaryWriter*>(DATA_PTR(self))) {
+      mrb_cpp_delete(mrb, old);
+      DATA_PTR(self) = nullptr;
+    }
+    mrb_cpp_new<BinaryWriter>(mrb, self, new_buffer(mrb, self, capa));
+
+    return self;
+  }
+
+  template <typename T, order O>
+  mrb_value writer_write(mrb_state* mrb, mrb_value self) {
+    mrb_value num;
+    mrb_get_args(mrb, "o", &num);
+    BinaryWriter* writer = get_writer(mrb, self);
+
+    T v;
+    if constexpr (std::is_floating_point_v<T>) {
+      v = mrbcpp::value_converter::to_floating<T>(mrb, num);
+    } else {
+      v = mrbcpp::value_converter::to_integral<T>(mrb, num);
+    }
+    char tmp[sizeof(T)];
+    mrbcpp::endian::encode<T, O>(tmp, v);
+    writer->append(mrb, tmp, sizeof(T));
+
+    return self;
+  }
+
+  mrb_value writer_write_varint(mrb_state* mrb, mrb_value self) {
+    mrb_value num;
+    mrb_bool zigzag = FALSE;
+    mrb_get_args(mrb, "o|b", &num, &zigzag);
+    BinaryWriter* writer = get_writer(mrb, self);
+
+    // same encoding as Integer#to_varint
+    uint8_t tmp[MRB_VARINT_MAX_LEN];
+    writer->append(mrb, tmp, mrb_varint_encode(mrb_varint_value(mrb, num, zigzag), tmp));
+
+    return self;
+  }
+
+  mrb_value writer_write_bytes(mrb_state* mrb, mrb_value self) {
+    const char* p;
+    mrb_int len;
+    mrb_get_args(mrb, "s", &p, &len);
+    get_writer(mrb, self)->append(mrb, p, static_cast<size_t>(len));
+    return self;
+  }
+
+  mrb_value writer_size(mrb_state* mrb, mrb_value self) {
+    return mrb_int_value(mrb, RSTRING_LEN(get_writer(mrb, self)->buffer));
+  }
+
+  // Hands the written String over to the caller, the writer starts over with an empty one
+  mrb_value writer_to_s(mrb_state* mrb, mrb_value self) {
+    BinaryWriter* writer = get_writer(mrb, self);
+    mrb_value out = writer->buffer;
+    writer->buffer = new_buffer(mrb, self, 0);
+    return out;
+  }
+
+  template <typename T>
+  void define_writers(mrb_state* mrb, struct RClass* cls, const char* le, const char* be) {
+    mrb_define_method(mrb, cls, le, writer_write<T, order::little>, MRB_ARGS_REQ(1));
+    mrb_define_method(mrb, cls, be, writer_write<T, order::big>, MRB_ARGS_REQ(1));
+  }
+}
+
+MRB_BEGIN_DECL
+void
+mrb_c_ext_helpers_binary_writer_init(mrb_state* mrb)
+{
+  struct RClass* mod = mrb_define_module(mrb, "CExtHelpers");
+  struct RClass* cls = mrb_define_class_under(mrb, mod, "BinaryWriter", mrb->object_class);
+  MRB_SET_INSTANCE_TT(cls, MRB_TT_DATA);
+
+  mrb_define_method(mrb, cls, "initialize", writer_initialize, MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, cls, "write_u8", writer_write<uint8_t, order::native>, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, cls, "write_i8", writer_write<int8_t, order::native>, MRB_ARGS_REQ(1));
+  define_writers<uint16_t>(mrb, cls, "write_u16_le", "write_u16_be");
+  define_writers<int16_t>(mrb, cls, "write_i16_le", "write_i16_be");
+  define_writers<uint32_t>(mrb, cls, "write_u32_le", "write_u32_be");
+  define_writers<int32_t>(mrb, cls, "write_i32_le", "write_i32_be");
+  define_writers<uint64_t>(mrb, cls, "write_u64_le", "write_u64_be");
+  define_writers<int64_t>(mrb, cls, "write_i64_le", "write_i64_be");
+#ifndef MRB_NO_FLOAT
+  define_writers<float>(mrb, cls, "write_f32_le", "write_f32_be");
+  define_writers<double>(mrb, cls, "write_f64_le", "write_f64_be");
+#endif
+  mrb_define_method(mrb, cls, "write_varint", writer_write_varint, MRB_ARGS_ARG(1, 1));
+  mrb_define_method(mrb, cls, "write_bytes", writer_write_bytes, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, cls, "size", writer_size, MRB_ARGS_NONE());
+  mrb_define_method(mrb, cls, "to_s", writer_to_s, MRB_ARGS_NONE());
+}
+MRB_END_DECL
@@ -0,0 +1,60 @@
+#include <mruby.h>
+#include <mruby/num_helpers.h>
+#include <mruby/endian_codec.hpp>
+
+namespace {
+  using mrbcpp::endian::order;
+
+  // Adds (or subtracts) by to the least significant end of buf and carries a
+  // whole 64 bit word at a time towards the most significant end, stopping as
+  // soon as nothing is left to carry. Returns the carry out of the top byte.
+  template <order O, bool Sub>
+  bool bytes_step(uint8_t* buf, size_t len, uint64_t by) {
+    uint64_t carry = by;
+    size_t done = 0;
+
+    for (; carry && done + 8 <= len; done += 8) {
+      uint8_t* p = O == order::big ? buf + len - done - 8 : buf + done;
+      uint64_t w = mrbcpp::endian::decode<uint64_t, O>(p);
+      uint64_t r;
+      if constexpr (Sub) {
+        r = w - carry;
+        carry = r > w;
+      } else {
+        r = w + carry;
+        carry = r < w;
+      }
+      mrbcpp::endian::encode<uint64_t, O>(p, r);
+    }
+
+    for (; carry && done < len; ++done) {
+      uint8_t* p = O == order::big ? buf + len - done - 1 : buf + done;
+      uint64_t w = *p;
+      uint64_t r;
+      if constexpr (Sub) {
+        r = w - (carry & 0xff);
+        carry = (carry >> 8) + (r > w);
+      } else {
+        r = w + (carry & 0xff);
+        carry = (carry >> 8) + (r >> 8);
+      }
+      *p = static_cast<uint8_t>(r);
+    }
+
+    return carry != 0;
+  }
+}
+
+MRB_API mrb_bool
+mrb_bytes_add(uint8_t *buf, size_t len, uint64_t by, mrb_byte_order bo)
+{
+  return bo == MRB_BYTE_ORDER_BE ? bytes_step<order::big, false>(buf, len, by)
+                                 : bytes_step<order::little, false>(buf, len, by);
+}
+
+MRB_API mrb_bool
+mrb_bytes_sub(uint8_t *buf, size_t len, uint64_t by, mrb_byte_order bo)
+{
+  return bo == MRB_BYTE_ORDER_BE ? bytes_step<order::big, true>(buf, len, by)
+                                 : bytes_step<order::little, true>(buf, len, by);
+}
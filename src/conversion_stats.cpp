@@ -0,0 +1,59 @@
+#include <mruby.h>
+#include <mruby/hash.h>
+#include <mruby/presym.h>
+#include <mruby/num_helpers.h>
+#include <mruby/converter_context.hpp>
+
+namespace {
+  mrb_value counter_hash(mrb_state* mrb, const mrb_conversion_counter& c) {
+    mrb_value h = mrb_hash_new_capa(mrb, 4);
+    mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(calls)), mrb_convert_uint64(mrb, c.calls));
+    mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(elements)), mrb_convert_uint64(mrb, c.elements));
+    mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(bytes)), mrb_convert_uint64(mrb, c.bytes));
+    mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(time_ns)), mrb_convert_uint64(mrb, c.nanoseconds));
+    return h;
+  }
+
+  // CExtHelpers::Stats.to_h, one entry per conversion path
+  mrb_value stats_to_h(mrb_state* mrb, mrb_value self) {
+    static const mrb_sym names[MRB_CONV_PATH_COUNT] = {
+      MRB_SYM(cpp_to_mrb), MRB_SYM(scalar), MRB_SYM(string), MRB_SYM(array), MRB_SYM(numbers),
+      MRB_SYM(map), MRB_SYM(set), MRB_SYM(described), MRB_SYM(time), MRB_SYM(to_any),
+      MRB_SYM(encode), MRB_SYM(decode)
+    };
+    const mrb_conversion_counter* counters = mrb_converter_context_get(mrb)->conversion_stats;
+    mrb_value result = mrb_hash_new_capa(mrb, MRB_CONV_PATH_COUNT);
+    int arena_index = mrb_gc_arena_save(mrb);
+    for (int i = 0; i < MRB_CONV_PATH_COUNT; ++i) {
+      mrb_hash_set(mrb, result, mrb_symbol_value(names[i]), counter_hash(mrb, counters[i]));
+      mrb_gc_arena_restore(mrb, arena_index);
+    }
+    return result;
+  }
+
+  mrb_value stats_reset(mrb_state* mrb, mrb_value self) {
+    mrb_converter_context* ctx = mrb_converter_context_get(mrb);
+    for (mrb_conversion_counter& counter : ctx->conversion_stats) counter = mrb_conversion_counter();
+    return mrb_nil_value();
+  }
+
+  mrb_value stats_enabled(mrb_state* mrb, mrb_value self) {
+#ifdef MRB_CONVERSION_STATS
+    return mrb_true_value();
+#else
+    return mrb_false_value();
+#endif
+  }
+}
+
+MRB_BEGIN_DECL
+void
+mrb_c_ext_helpers_conversion_stats_init(mrb_state* mrb)
+{
+  struct RClass* mod = mrb_define_module(mrb, "CExtHelpers");
+  struct RClass* stats = mrb_define_module_under(mrb, mod, "Stats");
+  mrb_define_module_function(mrb, stats, "to_h", stats_to_h, MRB_ARGS_NONE());
+  mrb_define_module_function(mrb, stats, "reset", stats_reset, MRB_ARGS_NONE());
+  mrb_define_module_function(mrb, stats, "enabled?", stats_enabled, MRB_ARGS_NONE());
+}
+MRB_END_DECL
@@ -0,0 +1,130 @@
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/class.h>
+#include <mruby/data.h>
+#include <mruby/variable.h>
+#include <mruby/presym.h>
+#include <mruby/cpp_helpers.hpp>
+#include <mruby/converter_context.hpp>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+MRB_CPP_DEFINE_TYPE(mrb_converter_context, converter_context)
+
+namespace {
+  // The last context handed out on this thread, saves the instance variable lookup
+  // for back to back conversions on the same mrb_state.
+  // A closed state may be freed and its address reused by a new one, possibly while
+  // another thread still caches it, so every close bumps the epoch and drops all caches.
+  struct context_cache {
+    mrb_state* mrb = nullptr;
+    mrb_converter_context* ctx = nullptr;
+    uint64_t epoch = 0;
+  };
+  thread_local context_cache last_context;
+  std::atomic<uint64_t> context_epoch{1};
+
+  mrb_value context_owner(mrb_state* mrb) {
+    return mrb_obj_value(mrb_module_get_id(mrb, MRB_SYM(CExtHelpers)));
+  }
+
+  mrb_converter_context* context_create(mrb_state* mrb) {
+    struct RData* data = mrb_data_object_alloc(mrb, mrb->object_class, nullptr, nullptr);
+    mrb_value holder = mrb_obj_value(data);
+    // instance variables without an @ are invisible from ruby
+    mrb_iv_set(mrb, context_owner(mrb), MRB_SYM(converter_context), holder);
+    mrb_converter_context* ctx = mrb_cpp_new<mrb_converter_context>(mrb, holder);
+    ctx->holder = holder;
+    return ctx;
+  }
+}
+
+MRB_API mrb_converter_context*
+mrb_converter_context_get(mrb_state* mrb)
+{
+  uint64_t epoch = context_epoch.load(std::memory_order_acquire);
+  if (likely(last_context.mrb == mrb && last_context.epoch == epoch)) return last_context.ctx;
+
+  mrb_value holder = mrb_iv_get(mrb, context_owner(mrb), MRB_SYM(converter_context));
+  mrb_converter_context* ctx = mrb_nil_p(holder)
+    ? context_create(mrb)
+    : mrb_cpp_get<mrb_converter_context>(mrb, holder);
+
+  last_context.mrb = mrb;
+  last_context.ctx = ctx;
+  last_context.epoch = epoch;
+  return ctx;
+}
+
+MRB_API struct RClass*
+mrb_converter_context_resolve(mrb_state* mrb, struct RClass** slot, mrb_sym name)
+{
+  if (unlikely(!mrb_class_defined_id(mrb, name))) {
+    mrb_raisef(mrb, E_NAME_ERROR, "%n class not defined — is it included in your mruby build?", name);
+  }
+  struct RClass* cls = mrb_class_get_id(mrb, name);
+  // keep the class reachable even when its constant gets removed
+  mrb_iv_set(mrb, mrb_converter_context_get(mrb)->holder, name, mrb_obj_value(cls));
+  *slot = cls;
+  return cls;
+}
+
+MRB_API const mrb_described_struct*
+mrb_converter_context_describe(mrb_state* mrb, const void* key, const char* const* names, size_t n)
+{
+  mrb_converter_context* ctx = mrb_converter_context_get(mrb);
+  auto it = ctx->described.find(key);
+  if (likely(it != ctx->described.end())) return &it->second;
+
+  mrb_described_struct desc;
+  desc.members.reserve(n);
+  mrb_value args = mrb_ary_new_capa(mrb, static_cast<mrb_int>(n));
+  for (size_t i = 0; i < n; ++i) {
+    mrb_sym sym = mrb_intern_static(mrb, names[i], strlen(names[i]));
+    desc.members.push_back(sym);
+    mrb_ary_push(mrb, args, mrb_symbol_value(sym));
+  }
+  mrb_value cls = mrb_funcall_argv(mrb, mrb_obj_value(mrb_converter_struct_class(mrb)), MRB_SYM(new),
+                                   RARRAY_LEN(args), RARRAY_PTR(args));
+  desc.cls = mrb_class_ptr(cls);
+
+  // anonymous Struct classes are only reachable from here
+  mrb_value keep = mrb_iv_get(mrb, ctx->holder, MRB_SYM(described));
+  if (mrb_nil_p(keep)) {
+    keep = mrb_ary_new(mrb);
+    mrb_iv_set(mrb, ctx->holder, MRB_SYM(described), keep);
+  }
+  mrb_ary_push(mrb, keep, cls);
+
+  return &ctx->described.emplace(key, std::move(desc)).first->second;
+}
+
+MRB_API void
+mrb_converter_context_invalidate(mrb_state* mrb)
+{
+  mrb_converter_context* ctx = mrb_converter_context_get(mrb);
+  ctx->time_class = nullptr;
+  ctx->set_class = nullptr;
+  ctx->struct_class = nullptr;
+}
+
+MRB_BEGIN_DECL
+void
+mrb_c_ext_helpers_converter_context_init(mrb_state* mrb)
+{
+  struct RClass* mod = mrb_define_module(mrb, "CExtHelpers");
+  mrb_define_module_function(mrb, mod, "invalidate_converter_context", [](mrb_state* mrb, mrb_value self) -> mrb_value {
+    mrb_converter_context_invalidate(mrb);
+    return mrb_nil_value();
+  }, MRB_ARGS_NONE());
+  mrb_converter_context_get(mrb);
+}
+
+void
+mrb_c_ext_helpers_converter_context_final(mrb_state* mrb)
+{
+  context_epoch.fetch_add(1, std::memory_order_acq_rel);
+  last_context = context_cache();
+}
+MRB_END_DECL
@@ -0,0 +1,94 @@
+#include <mruby.h>
+#include <mruby/data.h>
+#include <mruby/hash.h>
+#include <mruby/string.h>
+#include <mruby/presym.h>
+#include <mruby/cpp_object_stats.hpp>
+#include <mruby/converter_context.hpp>
+#include <algorithm>
+
+namespace {
+  // mruby frees the remaining objects after the gem got finalized, by then the
+  // context may be gone already, so their frees aren't counted anymore
+  thread_local mrb_state* finalized_state = nullptr;
+
+  // sizes of objects which own memory can change, so they are asked again on every read
+  void sum_bytes(mrb_cpp_object_counter& counter) {
+    counter.stats.bytes = counter.fixed_bytes;
+    for (const auto& [ptr, size_of] : counter.sized) counter.stats.bytes += size_of(ptr);
+  }
+}
+
+MRB_API void
+mrb_cpp_object_stats_add(mrb_state* mrb, const mrb_data_type* type, const void* ptr, size_t size, mrb_cpp_size_fn size_of)
+{
+  if (unlikely(finalized_state == mrb)) return;
+  mrb_cpp_object_counter& counter = mrb_converter_context_get(mrb)->object_stats[type];
+  if (size_of) {
+    counter.sized[ptr] = size_of;
+  } else {
+    counter.fixed_bytes += size;
+  }
+  counter.stats.allocated++;
+  counter.stats.live++;
+}
+
+MRB_API void
+mrb_cpp_object_stats_remove(mrb_state* mrb, const mrb_data_type* type, const void* ptr, size_t size)
+{
+  if (unlikely(finalized_state == mrb)) return;
+  mrb_converter_context* ctx = mrb_converter_context_get(mrb);
+  auto it = ctx->object_stats.find(type);
+  if (it == ctx->object_stats.end() || it->second.stats.live == 0) return;
+  mrb_cpp_object_counter& counter = it->second;
+  if (counter.sized.empty() || counter.sized.erase(ptr) == 0) {
+    counter.fixed_bytes -= std::min(size, counter.fixed_bytes);
+  }
+  counter.stats.freed++;
+  counter.stats.live--;
+}
+
+MRB_API mrb_bool
+mrb_cpp_object_stats_get(mrb_state* mrb, const mrb_data_type* type, mrb_cpp_object_stats* stats)
+{
+  mrb_converter_context* ctx = mrb_converter_context_get(mrb);
+  auto it = ctx->object_stats.find(type);
+  if (it == ctx->object_stats.end()) return FALSE;
+  sum_bytes(it->second);
+  *stats = it->second.stats;
+  return TRUE;
+}
+
+namespace {
+  mrb_value object_stats(mrb_state* mrb, mrb_value self) {
+    mrb_converter_context* ctx = mrb_converter_context_get(mrb);
+    mrb_value result = mrb_hash_new_capa(mrb, static_cast<mrb_int>(ctx->object_stats.size()));
+    for (auto& [type, counter] : ctx->object_stats) {
+      sum_bytes(counter);
+      const mrb_cpp_object_stats& s = counter.stats;
+      mrb_value h = mrb_hash_new_capa(mrb, 4);
+      mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(live)), mrb_int_value(mrb, static_cast<mrb_int>(s.live)));
+      mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(allocated)), mrb_int_value(mrb, static_cast<mrb_int>(s.allocated)));
+      mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(freed)), mrb_int_value(mrb, static_cast<mrb_int>(s.freed)));
+      mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(bytes)), mrb_int_value(mrb, static_cast<mrb_int>(s.bytes)));
+      mrb_hash_set(mrb, result, mrb_str_new_cstr(mrb, type->struct_name), h);
+    }
+    return result;
+  }
+}
+
+MRB_BEGIN_DECL
+void
+mrb_c_ext_helpers_cpp_object_stats_init(mrb_state* mrb)
+{
+  if (finalized_state == mrb) finalized_state = nullptr;
+  struct RClass* mod = mrb_define_module(mrb, "CExtHelpers");
+  mrb_define_module_function(mrb, mod, "object_stats", object_stats, MRB_ARGS_NONE());
+}
+
+void
+mrb_c_ext_helpers_cpp_object_stats_final(mrb_state* mrb)
+{
+  finalized_state = mrb;
+}
+MRB_END_DECL
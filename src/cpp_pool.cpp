@@ -0,0 +1,200 @@
+#include <mruby.h>
+#include <mruby/data.h>
+#include <mruby/hash.h>
+#include <mruby/string.h>
+#include <mruby/presym.h>
+#include <mruby/cpp_pool.hpp>
+#include <mruby/converter_context.hpp>
+#include <cstdint>
+#include <new>
+
+namespace {
+  constexpr size_t slab_bytes = 16 * 1024;
+  constexpr size_t min_slots = 16;
+  constexpr size_t max_align = alignof(std::max_align_t);
+
+  constexpr size_t round_up(size_t n, size_t align) {
+    return (n + align - 1) & ~(align - 1);
+  }
+
+  // the slots start right after this, max_align aligned
+  struct alignas(std::max_align_t) slab {
+    slab* next;
+  };
+
+  // freed slots form a list through their object storage
+  struct free_slot {
+    free_slot* next;
+  };
+
+  // header words of objects from mrb_malloc have the low bit set and hold
+  // the distance to the start of their block
+  inline uintptr_t& header_of(void* ptr) {
+    return reinterpret_cast<uintptr_t*>(ptr)[-1];
+  }
+
+  inline size_t header_size(size_t align) {
+    return round_up(sizeof(uintptr_t), align < alignof(uintptr_t) ? alignof(uintptr_t) : align);
+  }
+}
+
+struct mrb_cpp_pool {
+  size_t offset;          // from the start of a slot to the object
+  size_t stride;
+  size_t slots_per_slab;
+  slab* slabs = nullptr;
+  free_slot* free_list = nullptr;
+  char* bump = nullptr;   // uncarved part of the newest slab
+  char* bump_end = nullptr;
+  bool closed = false;
+  mrb_cpp_pool_stats stats;
+
+  void* take(mrb_state* mrb) {
+    if (free_list) {
+      void* obj = free_list;
+      free_list = free_list->next;
+      stats.recycled++;
+      return obj;
+    }
+    if (unlikely(bump == bump_end)) {
+      slab* s = static_cast<slab*>(mrb_malloc(mrb, sizeof(slab) + stride * slots_per_slab));
+      s->next = slabs;
+      slabs = s;
+      bump = reinterpret_cast<char*>(s + 1);
+      bump_end = bump + stride * slots_per_slab;
+      stats.slabs++;
+      stats.capacity += slots_per_slab;
+    }
+    char* slot = bump;
+    bump += stride;
+    void* obj = slot + offset;
+    header_of(obj) = reinterpret_cast<uintptr_t>(this);
+    return obj;
+  }
+
+  void release(mrb_state* mrb) {
+    while (slabs) {
+      slab* next = slabs->next;
+      mrb_free(mrb, slabs);
+      slabs = next;
+    }
+    this->~mrb_cpp_pool();
+    mrb_free(mrb, this);
+  }
+};
+
+namespace {
+  void* heap_alloc(mrb_state* mrb, size_t size, size_t align) {
+    size_t offset = header_size(align);
+    char* base = static_cast<char*>(mrb_malloc(mrb, offset + size));
+    void* obj = base + offset;
+    header_of(obj) = (offset << 1) | 1;
+    return obj;
+  }
+
+  mrb_cpp_pool* pool_create(mrb_state* mrb, size_t slot_size, size_t slot_align) {
+    if (slot_align < alignof(free_slot)) slot_align = alignof(free_slot);
+    if (slot_size < sizeof(free_slot)) slot_size = sizeof(free_slot);
+    mrb_cpp_pool* pool = new (mrb_malloc(mrb, sizeof(mrb_cpp_pool))) mrb_cpp_pool();
+    pool->offset = header_size(slot_align);
+    pool->stride = round_up(pool->offset + slot_size, slot_align);
+    pool->slots_per_slab = slab_bytes / pool->stride > min_slots ? slab_bytes / pool->stride : min_slots;
+    pool->stats.slot_size = pool->stride;
+    return pool;
+  }
+}
+
+MRB_API void*
+mrb_cpp_pool_alloc(mrb_state* mrb, const mrb_data_type* type, size_t slot_size, size_t slot_align, size_t size, size_t align)
+{
+  mrb_converter_context* ctx = mrb_converter_context_get(mrb);
+  if (unlikely(ctx->pools_closed || align > max_align)) {
+    return heap_alloc(mrb, size, align);
+  }
+
+  mrb_cpp_pool*& pool = ctx->pools[type];
+  if (unlikely(!pool)) pool = pool_create(mrb, slot_size, slot_align);
+  pool->stats.allocations++;
+  if (unlikely(size > slot_size || align > slot_align)) {
+    pool->stats.fallbacks++;
+    return heap_alloc(mrb, size, align);
+  }
+  pool->stats.live++;
+  return pool->take(mrb);
+}
+
+MRB_API void
+mrb_cpp_pool_free(mrb_state* mrb, void* ptr)
+{
+  if (!ptr) return;
+  uintptr_t header = header_of(ptr);
+  if (header & 1) {
+    mrb_free(mrb, static_cast<char*>(ptr) - (header >> 1));
+    return;
+  }
+
+  mrb_cpp_pool* pool = reinterpret_cast<mrb_cpp_pool*>(header);
+  free_slot* slot = static_cast<free_slot*>(ptr);
+  slot->next = pool->free_list;
+  pool->free_list = slot;
+  // a closed pool goes away with its last object
+  if (--pool->stats.live == 0 && pool->closed) {
+    pool->release(mrb);
+  }
+}
+
+MRB_API mrb_bool
+mrb_cpp_pool_stats_get(mrb_state* mrb, const mrb_data_type* type, mrb_cpp_pool_stats* stats)
+{
+  mrb_converter_context* ctx = mrb_converter_context_get(mrb);
+  auto it = ctx->pools.find(type);
+  if (it == ctx->pools.end()) return FALSE;
+  *stats = it->second->stats;
+  return TRUE;
+}
+
+namespace {
+  mrb_value pool_stats(mrb_state* mrb, mrb_value self) {
+    mrb_converter_context* ctx = mrb_converter_context_get(mrb);
+    mrb_value result = mrb_hash_new_capa(mrb, static_cast<mrb_int>(ctx->pools.size()));
+    for (const auto& [type, pool] : ctx->pools) {
+      const mrb_cpp_pool_stats& s = pool->stats;
+      mrb_value h = mrb_hash_new_capa(mrb, 7);
+      mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(slot_size)), mrb_int_value(mrb, static_cast<mrb_int>(s.slot_size)));
+      mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(slabs)), mrb_int_value(mrb, static_cast<mrb_int>(s.slabs)));
+      mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(capacity)), mrb_int_value(mrb, static_cast<mrb_int>(s.capacity)));
+      mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(live)), mrb_int_value(mrb, static_cast<mrb_int>(s.live)));
+      mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(allocations)), mrb_int_value(mrb, static_cast<mrb_int>(s.allocations)));
+      mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(recycled)), mrb_int_value(mrb, static_cast<mrb_int>(s.recycled)));
+      mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(fallbacks)), mrb_int_value(mrb, static_cast<mrb_int>(s.fallbacks)));
+      mrb_hash_set(mrb, result, mrb_str_new_cstr(mrb, type->struct_name), h);
+    }
+    return result;
+  }
+}
+
+MRB_BEGIN_DECL
+void
+mrb_c_ext_helpers_cpp_pool_init(mrb_state* mrb)
+{
+  struct RClass* mod = mrb_define_module(mrb, "CExtHelpers");
+  mrb_define_module_function(mrb, mod, "pool_stats", pool_stats, MRB_ARGS_NONE());
+}
+
+// Runs before mruby frees the remaining objects, so pools still in use are only
+// marked closed here and give their slabs back once their last object is freed.
+void
+mrb_c_ext_helpers_cpp_pool_final(mrb_state* mrb)
+{
+  mrb_converter_context* ctx = mrb_converter_context_get(mrb);
+  for (auto& [type, pool] : ctx->pools) {
+    if (pool->stats.live == 0) {
+      pool->release(mrb);
+    } else {
+      pool->closed = true;
+    }
+  }
+  ctx->pools.clear();
+  ctx->pools_closed = true;
+}
+MRB_END_DECL
@@ -1,7 +1,11 @@
 #include <mruby.h>
 #include <mruby/num_helpers.h>
 #include <mruby/string.h>
+#include <mruby/presym.h>
 #include <string.h>
+#ifdef MRB_USE_BIGINT
+#include <mruby/internal.h>
+#endif
 
 static mrb_value
 mrb_str_incr(mrb_state *mrb, mrb_value self)
@@ -20,16 +24,96 @@ mrb_str_incr(mrb_state *mrb, mrb_value self)
   return self;
 }
 
+static mrb_value
+mrb_str_step_bang(mrb_state *mrb, mrb_value self, mrb_bool sub)
+{
+  mrb_int by = 1;
+  mrb_sym kw_names[] = { MRB_SYM(endian), MRB_SYM(wrap) };
+  mrb_value kw_values[2];
+  mrb_kwargs kwargs = { 2, 0, kw_names, kw_values, NULL };
+  mrb_get_args(mrb, "|i:", &by, &kwargs);
+
+  mrb_byte_order order = mrb_undef_p(kw_values[0]) ? MRB_BYTE_ORDER_BE : mrb_byte_order_from_sym(mrb, mrb_obj_to_sym(mrb, kw_values[0]));
+  mrb_bool wrap = !mrb_undef_p(kw_values[1]) && mrb_test(kw_values[1]);
+  if (by < 0) {
+    sub = !sub;
+  }
+  uint64_t amount = by < 0 ? (uint64_t) 0 - (uint64_t) by : (uint64_t) by;
+
+  mrb_str_modify(mrb, RSTRING(self));
+  uint8_t *buf = (uint8_t *) RSTRING_PTR(self);
+  size_t len = (size_t) RSTRING_LEN(self);
+  mrb_bool wrapped = sub ? mrb_bytes_sub(buf, len, amount, order) : mrb_bytes_add(buf, len, amount, order);
+  if (wrapped && !wrap) {
+    /* undo, so the counter is left untouched */
+    if (sub) mrb_bytes_add(buf, len, amount, order); else mrb_bytes_sub(buf, len, amount, order);
+    mrb_raise(mrb, E_RANGE_ERROR, "counter wrapped around");
+  }
+
+  return self;
+}
+
+static mrb_value
+mrb_str_incr_bang(mrb_state *mrb, mrb_value self)
+{
+  return mrb_str_step_bang(mrb, self, FALSE);
+}
+
+static mrb_value
+mrb_str_decr_bang(mrb_state *mrb, mrb_value self)
+{
+  return mrb_str_step_bang(mrb, self, TRUE);
+}
+
 static mrb_value
 mrb_bin2fix(mrb_state *mrb, mrb_value self)
 {
   return MRB_DECODE_FIX_NAT(mrb, self);
 }
 
+static mrb_byte_order
+mrb_byte_order_arg(mrb_state *mrb, mrb_sym order)
+{
+  return order ? mrb_byte_order_from_sym(mrb, order) : mrb_byte_order_from_sym(mrb, MRB_SYM(native));
+}
+
 static mrb_value
 mrb_fix2bin(mrb_state *mrb, mrb_value self)
 {
-  return MRB_ENCODE_FIX_NAT(mrb, mrb_fixnum(self));
+  mrb_int width;
+  mrb_sym order = 0;
+  mrb_num_type type;
+  mrb_int argc = mrb_get_args(mrb, "|in", &width, &order);
+  if (argc == 0) {
+    return MRB_ENCODE_FIX_NAT(mrb, mrb_fixnum(self));
+  }
+
+  mrb_bool neg;
+#ifdef MRB_USE_BIGINT
+  if (mrb_bigint_p(self)) {
+    neg = mrb_bint_sign(mrb, self) < 0;
+  }
+  else
+#endif
+  neg = mrb_integer_p(self) && mrb_integer(self) < 0;
+  switch (width) {
+    case 1:  type = neg ? MRB_NUM_I8   : MRB_NUM_U8;   break;
+    case 2:  type = neg ? MRB_NUM_I16  : MRB_NUM_U16;  break;
+    case 4:  type = neg ? MRB_NUM_I32  : MRB_NUM_U32;  break;
+    case 8:  type = neg ? MRB_NUM_I64  : MRB_NUM_U64;  break;
+    case 16: type = neg ? MRB_NUM_I128 : MRB_NUM_U128; break;
+    default: mrb_raise(mrb, E_ARGUMENT_ERROR, "width must be 1, 2, 4, 8 or 16");
+  }
+
+  return mrb_encode_number(mrb, self, type, mrb_byte_order_arg(mrb, order));
+}
+
+static mrb_value
+mrb_str_to_num(mrb_state *mrb, mrb_value self)
+{
+  mrb_sym type, order = 0;
+  mrb_get_args(mrb, "n|n", &type, &order);
+  return mrb_decode_number(mrb, self, mrb_num_type_from_sym(mrb, type), mrb_byte_order_arg(mrb, order));
 }
 
 static mrb_value
@@ -60,7 +144,17 @@ mrb_fix2bin_be(mrb_state *mrb, mrb_value self)
 static mrb_value
 mrb_flo2bin(mrb_state *mrb, mrb_value self)
 {
-  return MRB_ENCODE_FLO_NAT(mrb, mrb_float(self));
+  mrb_int width;
+  mrb_sym order = 0;
+  mrb_int argc = mrb_get_args(mrb, "|in", &width, &order);
+  if (argc == 0) {
+    return MRB_ENCODE_FLO_NAT(mrb, mrb_float(self));
+  }
+  if (width != 4 && width != 8) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "width must be 4 or 8");
+  }
+
+  return mrb_encode_number(mrb, self, width == 4 ? MRB_NUM_F32 : MRB_NUM_F64, mrb_byte_order_arg(mrb, order));
 }
 
 static mrb_value
@@ -94,24 +188,154 @@ mrb_bin2flo_be(mrb_state *mrb, mrb_value self)
 }
 #endif // MRB_WITHOUT_FLOAT
 
+static mrb_value
+mrb_ary2bin_le(mrb_state *mrb, mrb_value self)
+{
+  mrb_sym type;
+  mrb_get_args(mrb, "n", &type);
+  return mrb_pack_numbers(mrb, self, mrb_num_type_from_sym(mrb, type), MRB_BYTE_ORDER_LE);
+}
+
+static mrb_value
+mrb_ary2bin_be(mrb_state *mrb, mrb_value self)
+{
+  mrb_sym type;
+  mrb_get_args(mrb, "n", &type);
+  return mrb_pack_numbers(mrb, self, mrb_num_type_from_sym(mrb, type), MRB_BYTE_ORDER_BE);
+}
+
+static mrb_value
+mrb_bin2ary_le(mrb_state *mrb, mrb_value self)
+{
+  mrb_sym type;
+  mrb_get_args(mrb, "n", &type);
+  return mrb_unpack_numbers(mrb, self, mrb_num_type_from_sym(mrb, type), MRB_BYTE_ORDER_LE);
+}
+
+static mrb_value
+mrb_bin2ary_be(mrb_state *mrb, mrb_value self)
+{
+  mrb_sym type;
+  mrb_get_args(mrb, "n", &type);
+  return mrb_unpack_numbers(mrb, self, mrb_num_type_from_sym(mrb, type), MRB_BYTE_ORDER_BE);
+}
+
+static mrb_value
+mrb_str_bswap_bang(mrb_state *mrb, mrb_value self)
+{
+  mrb_int width;
+  mrb_get_args(mrb, "i", &width);
+  if (width != 1 && width != 2 && width != 4 && width != 8 && width != 16) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "width must be 1, 2, 4, 8 or 16");
+  }
+  if (RSTRING_LEN(self) % width != 0) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "string size must be a multiple of %d bytes", (int)width);
+  }
+
+  mrb_str_modify(mrb, RSTRING(self));
+  mrb_bswap_buffer(RSTRING_PTR(self), (size_t)(RSTRING_LEN(self) / width), (size_t)width);
+
+  return self;
+}
+
+static mrb_value
+mrb_int2varint(mrb_state *mrb, mrb_value self)
+{
+  return mrb_varint_pack(mrb, self, FALSE);
+}
+
+static mrb_value
+mrb_int2zigzag(mrb_state *mrb, mrb_value self)
+{
+  return mrb_varint_pack(mrb, self, TRUE);
+}
+
+static mrb_value
+mrb_str_unpack_varints(mrb_state *mrb, mrb_value self)
+{
+  mrb_bool zigzag = FALSE;
+  mrb_get_args(mrb, "|b", &zigzag);
+  return mrb_varint_unpack(mrb, self, zigzag);
+}
+
+static mrb_value
+mrb_str_each_varint(mrb_state *mrb, mrb_value self)
+{
+  mrb_bool zigzag = FALSE;
+  mrb_value block = mrb_nil_value();
+  mrb_get_args(mrb, "|b&", &zigzag, &block);
+  if (mrb_nil_p(block)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "no block given");
+  }
+
+  int ai = mrb_gc_arena_save(mrb);
+  mrb_int pos = 0;
+  while (pos < RSTRING_LEN(self)) {
+    uint64_t v;
+    size_t used = mrb_varint_decode((const uint8_t *) RSTRING_PTR(self) + pos, (size_t)(RSTRING_LEN(self) - pos), &v);
+    if (used == 0) {
+      mrb_raise(mrb, E_ARGUMENT_ERROR, "truncated or overlong varint");
+    }
+    pos += (mrb_int)used;
+    mrb_yield(mrb, block, zigzag ? mrb_convert_int64(mrb, mrb_zigzag_decode(v)) : mrb_convert_uint64(mrb, v));
+    mrb_gc_arena_restore(mrb, ai);
+  }
+
+  return self;
+}
+
+void mrb_c_ext_helpers_converter_context_init(mrb_state *mrb);
+void mrb_c_ext_helpers_converter_context_final(mrb_state *mrb);
+void mrb_c_ext_helpers_binary_reader_init(mrb_state *mrb);
+void mrb_c_ext_helpers_binary_writer_init(mrb_state *mrb);
+void mrb_c_ext_helpers_cpp_pool_init(mrb_state *mrb);
+void mrb_c_ext_helpers_cpp_pool_final(mrb_state *mrb);
+void mrb_c_ext_helpers_cpp_object_stats_init(mrb_state *mrb);
+void mrb_c_ext_helpers_cpp_object_stats_final(mrb_state *mrb);
+void mrb_c_ext_helpers_conversion_stats_init(mrb_state *mrb);
+
 void
 mrb_mruby_c_ext_helpers_gem_init(mrb_state* mrb)
 {
   mrb_define_method(mrb, mrb->string_class, "incr", mrb_str_incr, MRB_ARGS_NONE());
+  mrb_define_method(mrb, mrb->string_class, "incr!", mrb_str_incr_bang, MRB_ARGS_OPT(1) | MRB_ARGS_KEY(2, 0));
+  mrb_define_method(mrb, mrb->string_class, "decr!", mrb_str_decr_bang, MRB_ARGS_OPT(1) | MRB_ARGS_KEY(2, 0));
   mrb_define_method(mrb, mrb->string_class, "to_fix", mrb_bin2fix, MRB_ARGS_NONE());
-  mrb_define_method(mrb, mrb->integer_class, "to_bin", mrb_fix2bin, MRB_ARGS_NONE());
+  mrb_define_method(mrb, mrb->integer_class, "to_bin", mrb_fix2bin, MRB_ARGS_OPT(2));
+  mrb_define_method(mrb, mrb->string_class, "to_num", mrb_str_to_num, MRB_ARGS_ARG(1, 1));
   mrb_define_method(mrb, mrb->string_class, "to_fix_le", mrb_bin2fix_le, MRB_ARGS_NONE());
   mrb_define_method(mrb, mrb->integer_class, "to_bin_le", mrb_fix2bin_le, MRB_ARGS_NONE());
   mrb_define_method(mrb, mrb->string_class, "to_fix_be", mrb_bin2fix_be, MRB_ARGS_NONE());
   mrb_define_method(mrb, mrb->integer_class, "to_bin_be", mrb_fix2bin_be, MRB_ARGS_NONE());
 #ifndef MRB_WITHOUT_FLOAT
   mrb_define_method(mrb, mrb->string_class, "to_flo", mrb_bin2flo, MRB_ARGS_NONE());
-  mrb_define_method(mrb, mrb->float_class,  "to_bin", mrb_flo2bin, MRB_ARGS_NONE());
+  mrb_define_method(mrb, mrb->float_class,  "to_bin", mrb_flo2bin, MRB_ARGS_OPT(2));
   mrb_define_method(mrb, mrb->string_class, "to_flo_le", mrb_bin2flo_le, MRB_ARGS_NONE());
   mrb_define_method(mrb, mrb->float_class,  "to_bin_le", mrb_flo2bin_le, MRB_ARGS_NONE());
   mrb_define_method(mrb, mrb->string_class, "to_flo_be", mrb_bin2flo_be, MRB_ARGS_NONE());
   mrb_define_method(mrb, mrb->float_class,  "to_bin_be", mrb_flo2bin_be, MRB_ARGS_NONE());
 #endif
+  mrb_define_method(mrb, mrb->array_class,  "to_bin_le", mrb_ary2bin_le, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, mrb->array_class,  "to_bin_be", mrb_ary2bin_be, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, mrb->string_class, "unpack_le", mrb_bin2ary_le, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, mrb->string_class, "unpack_be", mrb_bin2ary_be, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, mrb->string_class, "bswap!", mrb_str_bswap_bang, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, mrb->integer_class, "to_varint", mrb_int2varint, MRB_ARGS_NONE());
+  mrb_define_method(mrb, mrb->integer_class, "to_zigzag", mrb_int2zigzag, MRB_ARGS_NONE());
+  mrb_define_method(mrb, mrb->string_class, "unpack_varints", mrb_str_unpack_varints, MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, mrb->string_class, "each_varint", mrb_str_each_varint, MRB_ARGS_OPT(1) | MRB_ARGS_BLOCK());
+
+  mrb_c_ext_helpers_converter_context_init(mrb);
+  mrb_c_ext_helpers_binary_reader_init(mrb);
+  mrb_c_ext_helpers_binary_writer_init(mrb);
+  mrb_c_ext_helpers_cpp_pool_init(mrb);
+  mrb_c_ext_helpers_cpp_object_stats_init(mrb);
+  mrb_c_ext_helpers_conversion_stats_init(mrb);
 }
 
-void mrb_mruby_c_ext_helpers_gem_final(mrb_state* mrb) {}
+void mrb_mruby_c_ext_helpers_gem_final(mrb_state* mrb)
+{
+  mrb_c_ext_helpers_cpp_object_stats_final(mrb);
+  mrb_c_ext_helpers_cpp_pool_final(mrb);
+  mrb_c_ext_helpers_converter_context_final(mrb);
+}
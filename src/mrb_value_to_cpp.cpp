@@ -3,119 +3,452 @@
 #include <mruby/array.h>
 #include <mruby/hash.h>
 #include <string>
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 #include <mruby/presym.h>
 #include <mruby/branch_pred.h>
 #include <mruby/numeric.h>
+#ifdef MRB_USE_BIGINT
+#include <mruby/internal.h>
+#endif
 
-MRB_API std::vector<std::any>
-mrb_array_to_vector(mrb_state* mrb, mrb_value ary)
+#ifdef MRB_USE_BIGINT
+namespace {
+    // The magnitude of Bigints within 64 bits, read without allocating. mruby has no
+    // allocation free way to look at wider ones, mrb_bint_as_(u)int64 raise for them and
+    // shifting or masking out the halves creates a Bigint per step, more than the one
+    // hexadecimal String the general path needs.
+    bool bint_magnitude64(mrb_state* mrb, mrb_value bint, mrb_big_integer& out) {
+#ifndef MRB_NO_FLOAT
+        // Bigints compare against a Float through a rounded copy, rounding is monotonic,
+        // so a strict compare against a power of two holds for the exact value as well
+        constexpr mrb_float two63 = 9223372036854775808.0;
+        uint64_t mag;
+        if (mrb_bint_sign(mrb, bint) >= 0) {
+            if (mrb_bint_cmp(mrb, bint, mrb_float_value(mrb, 2 * two63)) >= 0) return false;
+            mag = mrb_bint_as_uint64(mrb, bint);
+        } else {
+            if (mrb_bint_cmp(mrb, bint, mrb_float_value(mrb, -two63)) <= 0) return false;
+            mag = uint64_t(0) - static_cast<uint64_t>(mrb_bint_as_int64(mrb, bint));
+            out.negative = true;
+        }
+        for (; mag; mag >>= 8) out.magnitude.push_back(static_cast<char>(mag & 0xff));
+        return true;
+#else
+        (void) mrb; (void) bint; (void) out;
+        return false;
+#endif
+    }
+}
+
+MRB_API mrb_big_integer
+mrb_bint_to_big_integer(mrb_state* mrb, mrb_value bint)
 {
-    switch (mrb_type(ary)) {
-        case MRB_TT_ARRAY:
-        case MRB_TT_STRUCT:
-            break;
-        default: mrb_raise(mrb, E_TYPE_ERROR, "not an array or struct");
+    mrb_big_integer out;
+    // up to 8 bytes fit the small string buffer of the magnitude
+    if (bint_magnitude64(mrb, bint, out)) return out;
+    int arena_index = mrb_gc_arena_save(mrb);
+    std::string_view hex = mrb_str_view(mrb, mrb_integer_to_str(mrb, bint, 16));
+    if (!hex.empty() && hex.front() == '-') {
+        out.negative = true;
+        hex.remove_prefix(1);
     }
-    mrb_int len = RARRAY_LEN(ary);
-    std::vector<std::any> out;
-    out.reserve(len);
-    for (mrb_int i = 0; i < len; ++i) {
-        out.push_back(mrb_value_to_any(mrb, mrb_ary_ref(mrb, ary, i)));
+    auto nibble = [](char c) -> unsigned {
+        return c <= '9' ? static_cast<unsigned>(c - '0') : static_cast<unsigned>((c | 0x20) - 'a' + 10);
+    };
+    // two digits per byte, starting from the least significant end
+    out.magnitude.reserve((hex.size() + 1) / 2);
+    size_t i = hex.size();
+    while (i >= 2) {
+        out.magnitude.push_back(static_cast<char>(nibble(hex[i - 2]) << 4 | nibble(hex[i - 1])));
+        i -= 2;
     }
+    if (i == 1) out.magnitude.push_back(static_cast<char>(nibble(hex[0])));
+    while (!out.magnitude.empty() && out.magnitude.back() == '\0') out.magnitude.pop_back();
+    mrb_gc_arena_restore(mrb, arena_index);
     return out;
 }
 
-inline MapKey mrb_value_to_map_key(mrb_state* mrb, mrb_value val) {
+namespace {
+#if defined(__SIZEOF_INT128__)
+    using wide_int = __int128;
+    using wide_uint = unsigned __int128;
+#else
+    using wide_int = int64_t;
+    using wide_uint = uint64_t;
+#endif
+
+    // __int128 when the value fits, unsigned __int128 for the positive ones above its range,
+    // everything else stays an mrb_big_integer
+    std::any bigint_to_any(mrb_state* mrb, mrb_value val) {
+        mrb_big_integer big = mrb_bint_to_big_integer(mrb, val);
+        constexpr wide_uint sign_bit = wide_uint(1) << (sizeof(wide_uint) * 8 - 1);
+        wide_uint mag;
+        if (mrb_big_integer_magnitude(big, mag)) {
+            if (!big.negative) return mag < sign_bit ? std::any(static_cast<wide_int>(mag)) : std::any(mag);
+            if (mag <= sign_bit) return std::any(static_cast<wide_int>(wide_uint(0) - mag));
+        }
+        return std::any(std::move(big));
+    }
+}
+#endif
+
+// Returns false for values which cannot be a MapKey
+static bool map_key_of(mrb_state* mrb, mrb_value val, MapKey& key) {
     switch (mrb_type(val)) {
         case MRB_TT_FALSE:
-            return (mrb_integer(val) == 0) ? std::string("nil") : std::string("false");
+            key = (mrb_integer(val) == 0) ? std::string("nil") : std::string("false");
+            return true;
         case MRB_TT_TRUE:
-            return std::string("true");
-        case MRB_TT_SYMBOL: {
-            mrb_int len;
-            const char* s = mrb_sym_name_len(mrb, mrb_symbol(val), &len);
-            return std::string(s, static_cast<size_t>(len));
-        }
+            key = std::string("true");
+            return true;
+        case MRB_TT_SYMBOL:
+            key = std::string(mrb_str_view(mrb, val));
+            return true;
         case MRB_TT_UNDEF:
         case MRB_TT_FREE:
-            return std::string("undefined");
+            key = std::string("undefined");
+            return true;
 #ifndef MRB_NO_FLOAT
         case MRB_TT_FLOAT:
-            return mrb_float(val);
+            key = mrb_float(val);
+            return true;
 #endif
         case MRB_TT_INTEGER:
-            return mrb_integer(val);
+            key = mrb_integer(val);
+            return true;
         case MRB_TT_STRING:
-            return std::string(RSTRING_PTR(val), RSTRING_LEN(val));
+            key = std::string(mrb_str_view(mrb, val));
+            return true;
 #ifdef MRB_USE_BIGINT
-        case MRB_TT_BIGINT: {
-            mrb_value s = mrb_integer_to_str(mrb, val, 10);
-            return std::string(RSTRING_PTR(s), RSTRING_LEN(s));
-        }
+        case MRB_TT_BIGINT:
+            key = mrb_bint_to_big_integer(mrb, val);
+            return true;
 #endif
         default:
-            mrb_raise(mrb, E_TYPE_ERROR, "Unsupported or unhandled mrb_value type for map key");
+            return false;
     }
 }
 
+inline MapKey mrb_value_to_map_key(mrb_state* mrb, mrb_value val) {
+    MapKey key;
+    if (unlikely(!map_key_of(mrb, val, key))) {
+        mrb_raise(mrb, E_TYPE_ERROR, "Unsupported or unhandled mrb_value type for map key");
+    }
+    return key;
+}
+
+namespace {
+    // One pass over the Hash entries, no keys Array and no second lookup per key
+    template <typename Container, typename Insert>
+    Container hash_collect(mrb_state* mrb, mrb_value hash, Insert insert) {
+        if(unlikely(!mrb_hash_p(hash))) mrb_raise(mrb, E_TYPE_ERROR, "not a hash");
+        struct ctx_t {
+            Container out;
+            Insert insert;
+        } ctx{Container(), insert};
+        if constexpr (mrbcpp::value_converter::has_reserve_v<Container>) {
+            ctx.out.reserve(static_cast<size_t>(mrb_hash_size(mrb, hash)));
+        }
+        mrb_hash_foreach(mrb, mrb_hash_ptr(hash), [](mrb_state* mrb, mrb_value k, mrb_value v, void* data) -> int {
+            ctx_t* ctx = static_cast<ctx_t*>(data);
+            ctx->insert(ctx->out, mrb_value_to_map_key(mrb, k), mrb_value_to_any(mrb, v));
+            return 0;
+        }, &ctx);
+        return std::move(ctx.out);
+    }
+
+    struct emplace_entry {
+        template <typename Container>
+        void operator()(Container& out, MapKey&& k, std::any&& v) const {
+            out.emplace(std::move(k), std::move(v));
+        }
+    };
+
+    struct append_entry {
+        template <typename Container>
+        void operator()(Container& out, MapKey&& k, std::any&& v) const {
+            out.emplace_back(std::move(k), std::move(v));
+        }
+    };
+}
+
 MRB_API std::map<MapKey, std::any>
 mrb_hash_to_map(mrb_state* mrb, mrb_value hash)
 {
-    if(unlikely(!mrb_hash_p(hash))) mrb_raise(mrb, E_TYPE_ERROR, "not a hash");
-    std::map<MapKey, std::any> out;
-    mrb_value keys = mrb_hash_keys(mrb, hash);
-    mrb_gc_protect(mrb, keys);
-    mrb_int len = RARRAY_LEN(keys);
-    for (mrb_int i = 0; i < len; ++i) {
-        mrb_value k = mrb_ary_ref(mrb, keys, i);
-        mrb_value v = mrb_hash_get(mrb, hash, k);
-        out.emplace(mrb_value_to_map_key(mrb, k), mrb_value_to_any(mrb, v));
-    }
-    return out;
+    return hash_collect<std::map<MapKey, std::any>>(mrb, hash, emplace_entry());
 }
 
-MRB_API std::any
-mrb_value_to_any(mrb_state* mrb, mrb_value val)
+MRB_API std::unordered_map<MapKey, std::any>
+mrb_hash_to_unordered_map(mrb_state* mrb, mrb_value hash)
 {
-    switch (mrb_type(val)) {
-        case MRB_TT_FALSE:
-            return (mrb_integer(val) == 0) ? std::any{} : false;
-        case MRB_TT_TRUE:
-            return true;
-        case MRB_TT_SYMBOL: {
-            mrb_int len;
-            const char* s = mrb_sym_name_len(mrb, mrb_symbol(val), &len);
-            return std::string(s, static_cast<size_t>(len));
+    return hash_collect<std::unordered_map<MapKey, std::any>>(mrb, hash, emplace_entry());
+}
+
+MRB_API std::vector<std::pair<MapKey, std::any>>
+mrb_hash_to_pairs(mrb_state* mrb, mrb_value hash)
+{
+    return hash_collect<std::vector<std::pair<MapKey, std::any>>>(mrb, hash, append_entry());
+}
+
+MRB_API std::vector<std::pair<MapKey, std::any>>
+mrb_hash_to_sorted_pairs(mrb_state* mrb, mrb_value hash)
+{
+    auto out = mrb_hash_to_pairs(mrb, hash);
+    auto by_key = [](const auto& a, const auto& b) { return mrb_map_key_less()(a.first, b.first); };
+    std::stable_sort(out.begin(), out.end(), by_key);
+    out.erase(std::unique(out.begin(), out.end(), [](const auto& a, const auto& b) { return a.first == b.first; }), out.end());
+    return out;
+}
+
+namespace {
+    using AnyVector = std::vector<std::any>;
+    using AnyMap = std::map<MapKey, std::any>;
+
+    // Converts a value tree with an explicit stack instead of recursion, so the nesting
+    // depth is only limited by the heap (or options.max_depth) and not by the C stack.
+    // Containers currently being converted are tracked to detect cycles.
+    class any_converter {
+        struct frame {
+            mrb_value src;
+            bool is_hash;
+            mrb_value elements;                                  // Array, Struct or Set#to_a
+            std::vector<std::pair<mrb_value, mrb_value>> entries; // Hash entries, taken in one pass
+            size_t rooted = 0;                                   // entries before it are in keep_alive
+            mrb_int pos = 0;
+            AnyVector vec;
+            AnyMap map;
+            MapKey key;
+        };
+
+        mrb_state* mrb;
+        const mrb_any_options& options;
+        std::vector<frame> stack;
+        std::unordered_set<struct RBasic*> active;
+        std::unordered_map<struct RBasic*, std::any> converted;
+        mrb_value keep_alive = mrb_nil_value();
+        std::any result;
+        const char* error = nullptr;
+        struct RClass* error_class = nullptr;
+#ifdef MRB_CONVERSION_STATS
+        size_t delivered = 0;
+        size_t copied = 0;
+#endif
+
+        void fail(struct RClass* cls, const char* msg) {
+            error_class = cls;
+            error = msg;
         }
-        case MRB_TT_UNDEF:
-        case MRB_TT_FREE:
-            return std::any{};
+
+        void deliver(std::any&& value) {
+#ifdef MRB_CONVERSION_STATS
+            delivered++;
+            if (const std::string* str = std::any_cast<std::string>(&value)) copied += str->size();
+#endif
+            if (stack.empty()) {
+                result = std::move(value);
+                return;
+            }
+            frame& top = stack.back();
+            if (top.is_hash) {
+                top.map.emplace(std::move(top.key), std::move(value));
+            } else {
+                top.vec.push_back(std::move(value));
+            }
+        }
+
+        void push_frame(mrb_value val, bool is_hash, mrb_value elements) {
+            struct RBasic* obj = mrb_basic_ptr(val);
+            if (unlikely(options.max_depth && stack.size() >= options.max_depth)) {
+                return fail(E_ARGUMENT_ERROR, "nesting too deep");
+            }
+            if (unlikely(!active.insert(obj).second)) {
+                return fail(E_ARGUMENT_ERROR, "cyclic structure cannot be converted");
+            }
+            // ruby code run by Set#to_a may drop the last other reference to a container
+            // being converted, keeping it alive also keeps its address out of active/converted
+            if (mrb_nil_p(keep_alive)) keep_alive = mrb_ary_new(mrb);
+            mrb_ary_push(mrb, keep_alive, val);
+            stack.emplace_back();
+            frame& f = stack.back();
+            f.src = val;
+            f.is_hash = is_hash;
+            f.elements = elements;
+            if (is_hash) {
+                f.entries.reserve(static_cast<size_t>(mrb_hash_size(mrb, val)));
+                mrb_hash_foreach(mrb, mrb_hash_ptr(val), [](mrb_state*, mrb_value k, mrb_value v, void* data) -> int {
+                    static_cast<frame*>(data)->entries.emplace_back(k, v);
+                    return 0;
+                }, &f);
+            } else {
+                f.vec.reserve(static_cast<size_t>(RARRAY_LEN(elements)));
+            }
+        }
+
+        void pop_frame() {
+            frame& f = stack.back();
+            struct RBasic* obj = mrb_basic_ptr(f.src);
+            std::any value;
+            if (options.share) {
+                if (f.is_hash) {
+                    value = std::make_shared<AnyMap>(std::move(f.map));
+                } else {
+                    value = std::make_shared<AnyVector>(std::move(f.vec));
+                }
+                converted.emplace(obj, value);
+            } else if (f.is_hash) {
+                value = std::move(f.map);
+            } else {
+                value = std::move(f.vec);
+            }
+            active.erase(obj);
+            stack.pop_back();
+            deliver(std::move(value));
+        }
+
+        // Set#to_a runs ruby code which may modify the Hashes being converted, until then
+        // their remaining entries are only referenced from the frames
+        void root_pending_entries() {
+            for (frame& f : stack) {
+                if (!f.is_hash) continue;
+                for (size_t i = std::max(f.rooted, static_cast<size_t>(f.pos)); i < f.entries.size(); ++i) {
+                    mrb_ary_push(mrb, keep_alive, f.entries[i].first);
+                    mrb_ary_push(mrb, keep_alive, f.entries[i].second);
+                }
+                f.rooted = f.entries.size();
+            }
+        }
+
+        // Leaves are delivered right away, containers get a frame
+        void start(mrb_value val) {
+            if (options.share && !mrb_immediate_p(val)) {
+                auto it = converted.find(mrb_basic_ptr(val));
+                if (it != converted.end()) return deliver(std::any(it->second));
+            }
+            switch (mrb_type(val)) {
+                case MRB_TT_FALSE:
+                    return deliver((mrb_integer(val) == 0) ? std::any{} : std::any(false));
+                case MRB_TT_TRUE:
+                    return deliver(true);
+                case MRB_TT_SYMBOL:
+                case MRB_TT_STRING:
+                    return deliver(std::string(mrb_str_view(mrb, val)));
+                case MRB_TT_UNDEF:
+                case MRB_TT_FREE:
+                    return deliver(std::any{});
 #ifndef MRB_NO_FLOAT
-        case MRB_TT_FLOAT:
-            return mrb_float(val);
+                case MRB_TT_FLOAT:
+                    return deliver(mrb_float(val));
 #endif
-        case MRB_TT_INTEGER:
-            return mrb_integer(val);
-        case MRB_TT_HASH:
-            return mrb_hash_to_map(mrb, val);
-        case MRB_TT_STRING:
-            return std::string(RSTRING_PTR(val), RSTRING_LEN(val));
-        case MRB_TT_ARRAY:
-        case MRB_TT_STRUCT:
-            return mrb_array_to_vector(mrb, val);
+                case MRB_TT_INTEGER:
+                    return deliver(mrb_integer(val));
 #ifdef MRB_USE_BIGINT
-        case MRB_TT_BIGINT: {
-            mrb_value s = mrb_integer_to_str(mrb, val, 10);
-            return std::string(RSTRING_PTR(s), RSTRING_LEN(s));
-        }
+                case MRB_TT_BIGINT:
+                    return deliver(bigint_to_any(mrb, val));
 #endif
+                case MRB_TT_HASH:
+                    return push_frame(val, true, mrb_nil_value());
+                case MRB_TT_ARRAY:
+                case MRB_TT_STRUCT:
+                    return push_frame(val, false, val);
 #ifdef MRB_USE_SET
-        case MRB_TT_SET: {
-            mrb_value ary = mrb_funcall_id(mrb, val, MRB_SYM(to_a), 0);
-            return mrb_array_to_vector(mrb, ary);
+                case MRB_TT_SET: {
+                    if (mrb_nil_p(keep_alive)) keep_alive = mrb_ary_new(mrb);
+                    root_pending_entries();
+                    mrb_value ary = mrb_funcall_id(mrb, val, MRB_SYM(to_a), 0);
+                    mrb_ary_push(mrb, keep_alive, ary);
+                    return push_frame(val, false, ary);
+                }
+#endif
+                default:
+                    return fail(E_TYPE_ERROR, "Unsupported or unhandled mrb_value type");
+            }
+        }
+
+    public:
+        any_converter(mrb_state* mrb, const mrb_any_options& options) : mrb(mrb), options(options) {}
+
+        std::any run(mrb_value root) {
+            int arena_index = mrb_gc_arena_save(mrb);
+            start(root);
+            while (!stack.empty() && !error) {
+                frame& f = stack.back();
+                if (f.is_hash) {
+                    if (f.pos == static_cast<mrb_int>(f.entries.size())) {
+                        pop_frame();
+                        continue;
+                    }
+                    const auto& entry = f.entries[static_cast<size_t>(f.pos++)];
+                    if (unlikely(!map_key_of(mrb, entry.first, f.key))) {
+                        fail(E_TYPE_ERROR, "Unsupported or unhandled mrb_value type for map key");
+                        break;
+                    }
+                    start(entry.second);
+                } else {
+                    // re-read the length, converting a Set may run ruby code
+                    if (f.pos >= RARRAY_LEN(f.elements)) {
+                        pop_frame();
+                        continue;
+                    }
+                    start(RARRAY_PTR(f.elements)[f.pos++]);
+                }
+            }
+            mrb_gc_arena_restore(mrb, arena_index);
+            return std::move(result);
         }
+
+        void count(mrb_converter_timer& timer) const {
+#ifdef MRB_CONVERSION_STATS
+            timer.add(delivered, copied);
+#else
+            (void) timer;
 #endif
-        default:
-            mrb_raise(mrb, E_TYPE_ERROR, "Unsupported or unhandled mrb_value type");
+        }
+
+        const char* failure(struct RClass** cls) const {
+            *cls = error_class;
+            return error;
+        }
+    };
+}
+
+MRB_API std::any
+mrb_value_to_any(mrb_state* mrb, mrb_value val, const mrb_any_options& options)
+{
+    std::any out;
+    struct RClass* error_class = nullptr;
+    const char* error;
+    {
+        mrb_converter_timer timer(mrb, MRB_CONV_TO_ANY);
+        any_converter converter(mrb, options);
+        out = converter.run(val);
+        converter.count(timer);
+        error = converter.failure(&error_class);
+    }
+    if (unlikely(error)) {
+        // the C++ side is released before mrb_raise leaves this frame
+        out.reset();
+        mrb_raise(mrb, error_class, error);
+    }
+    return out;
+}
+
+MRB_API std::any
+mrb_value_to_any(mrb_state* mrb, mrb_value val)
+{
+    return mrb_value_to_any(mrb, val, mrb_any_options());
+}
+
+MRB_API std::vector<std::any>
+mrb_array_to_vector(mrb_state* mrb, mrb_value ary)
+{
+    switch (mrb_type(ary)) {
+        case MRB_TT_ARRAY:
+        case MRB_TT_STRUCT:
+            break;
+        default: mrb_raise(mrb, E_TYPE_ERROR, "not an array or struct");
     }
+    return std::any_cast<AnyVector>(mrb_value_to_any(mrb, ary));
 }
@@ -7,6 +7,8 @@
 #include <limits>
 #include <type_traits>
 #include <string>
+#include <mruby/endian_codec.hpp>
+#include <mruby/mrb_value_to_cpp.hpp>
 
 namespace mrbcpp::number_converter {
   template <typename T>
@@ -120,239 +122,194 @@ MRB_API mrb_value mrb_convert_double(mrb_state* mrb, double value) { \
   return mrb_convert_number(mrb, value); \
 }
 
+namespace mrbcpp::number_converter {
+  using mrbcpp::endian::order;
+
+  template <typename T, order O>
+  static mrb_value encode_number(mrb_state* mrb, T numeric) {
+    mrb_converter_timer timer(mrb, MRB_CONV_ENCODE);
+    timer.add(1, sizeof(T));
+    mrb_value bin = mrb_str_new(mrb, NULL, sizeof(T));
+    mrbcpp::endian::encode<T, O>(RSTRING_PTR(bin), numeric);
+    return bin;
+  }
+
+  template <typename T, order O>
+  static T decode_number(mrb_state* mrb, mrb_value bin) {
+    mrb_converter_timer timer(mrb, MRB_CONV_DECODE);
+    timer.add(1, sizeof(T));
+    if (unlikely(!mrb_string_p(bin))) mrb_raise(mrb, E_TYPE_ERROR, "Not a String");
+    if (RSTRING_LEN(bin) != sizeof(T)) mrb_raise(mrb, E_ARGUMENT_ERROR, "Encoded Data cannot be decoded");
+    return mrbcpp::endian::decode<T, O>(RSTRING_PTR(bin));
+  }
+
+  template <typename T, order O>
+  static mrb_value encode_value(mrb_state* mrb, mrb_value num) {
+    if constexpr (std::is_floating_point_v<T>) {
+      return encode_number<T, O>(mrb, mrbcpp::value_converter::to_floating<T>(mrb, num));
+    } else {
+      return encode_number<T, O>(mrb, mrbcpp::value_converter::to_integral<T>(mrb, num));
+    }
+  }
+
+  template <typename T, order O>
+  static mrb_value decode_value(mrb_state* mrb, mrb_value bin) {
+    return mrb_convert_number(mrb, decode_number<T, O>(mrb, bin));
+  }
+
+  template <template <typename, order> class F>
+  static mrb_value dispatch(mrb_state* mrb, mrb_num_type type, mrb_byte_order bo, mrb_value arg) {
+    const bool be = bo == MRB_BYTE_ORDER_BE;
+    switch (type) {
+      case MRB_NUM_I8:   return F<int8_t, order::native>::call(mrb, arg);
+      case MRB_NUM_U8:   return F<uint8_t, order::native>::call(mrb, arg);
+      case MRB_NUM_I16:  return be ? F<int16_t, order::big>::call(mrb, arg)  : F<int16_t, order::little>::call(mrb, arg);
+      case MRB_NUM_U16:  return be ? F<uint16_t, order::big>::call(mrb, arg) : F<uint16_t, order::little>::call(mrb, arg);
+      case MRB_NUM_I32:  return be ? F<int32_t, order::big>::call(mrb, arg)  : F<int32_t, order::little>::call(mrb, arg);
+      case MRB_NUM_U32:  return be ? F<uint32_t, order::big>::call(mrb, arg) : F<uint32_t, order::little>::call(mrb, arg);
+      case MRB_NUM_I64:  return be ? F<int64_t, order::big>::call(mrb, arg)  : F<int64_t, order::little>::call(mrb, arg);
+      case MRB_NUM_U64:  return be ? F<uint64_t, order::big>::call(mrb, arg) : F<uint64_t, order::little>::call(mrb, arg);
+#if defined(__SIZEOF_INT128__)
+      case MRB_NUM_I128: return be ? F<__int128, order::big>::call(mrb, arg) : F<__int128, order::little>::call(mrb, arg);
+      case MRB_NUM_U128: return be ? F<unsigned __int128, order::big>::call(mrb, arg) : F<unsigned __int128, order::little>::call(mrb, arg);
+#endif
+#ifndef MRB_NO_FLOAT
+      case MRB_NUM_F32:  return be ? F<float, order::big>::call(mrb, arg)    : F<float, order::little>::call(mrb, arg);
+      case MRB_NUM_F64:  return be ? F<double, order::big>::call(mrb, arg)   : F<double, order::little>::call(mrb, arg);
+#endif
+      default: mrb_raise(mrb, E_ARGUMENT_ERROR, "unsupported number type");
+    }
+  }
+
+  template <typename T, order O>
+  struct encode_fn {
+    static mrb_value call(mrb_state* mrb, mrb_value num) { return encode_value<T, O>(mrb, num); }
+  };
+
+  template <typename T, order O>
+  struct decode_fn {
+    static mrb_value call(mrb_state* mrb, mrb_value bin) { return decode_value<T, O>(mrb, bin); }
+  };
+}
+
+using mrbcpp::number_converter::encode_number;
+using mrbcpp::number_converter::decode_number;
+using mrbcpp::endian::order;
+
 MRB_API mrb_value
-MRB_ENCODE_FIX_NAT(mrb_state *mrb, mrb_int numeric)
+mrb_encode_number(mrb_state *mrb, mrb_value num, mrb_num_type type, mrb_byte_order bo)
 {
-  mrb_value bin = mrb_str_new(mrb, NULL, sizeof(numeric));
-  memcpy((uint8_t *) RSTRING_PTR(bin), &numeric, sizeof(numeric));
-  return bin;
+  return mrbcpp::number_converter::dispatch<mrbcpp::number_converter::encode_fn>(mrb, type, bo, num);
 }
 
 MRB_API mrb_value
-MRB_DECODE_FIX_NAT(mrb_state *mrb, mrb_value bin)
+mrb_decode_number(mrb_state *mrb, mrb_value bin, mrb_num_type type, mrb_byte_order bo)
 {
-  mrb_int numeric;
+  return mrbcpp::number_converter::dispatch<mrbcpp::number_converter::decode_fn>(mrb, type, bo, bin);
+}
 
-  if (unlikely(!mrb_string_p(bin))) mrb_raise(mrb, E_TYPE_ERROR, "Not a String");
-  if (RSTRING_LEN(bin) != sizeof(numeric)) mrb_raise(mrb, E_ARGUMENT_ERROR, "Encoded Data cannot be decoded");
+MRB_API mrb_value
+MRB_ENCODE_FIX_NAT(mrb_state *mrb, mrb_int numeric)
+{
+  return encode_number<mrb_int, order::native>(mrb, numeric);
+}
 
-  memcpy(&numeric, (const uint8_t *) RSTRING_PTR(bin), sizeof(numeric));
-  return mrb_int_value(mrb, numeric);
+MRB_API mrb_value
+MRB_DECODE_FIX_NAT(mrb_state *mrb, mrb_value bin)
+{
+  return mrb_int_value(mrb, decode_number<mrb_int, order::native>(mrb, bin));
 }
 
 MRB_API mrb_value
 MRB_ENCODE_FIX_LE(mrb_state *mrb, mrb_int numeric)
 {
-  mrb_value bin = mrb_str_new(mrb, NULL, sizeof(numeric));
-  mrb_gc_protect(mrb, bin);
-
-#ifdef MRB_ENDIAN_BIG
-    uint8_t *dst = (uint8_t *) RSTRING_PTR(bin);
-    for (int i = 0; i < sizeof(numeric) - 1; i++) {
-      dst[i] = (uint8_t) numeric;
-      numeric >>= 8;
-    }
-    dst[sizeof(numeric) - 1] = (uint8_t) numeric;
-#else
-    memcpy((uint8_t *) RSTRING_PTR(bin), &numeric, sizeof(numeric));
-#endif
-
-  return bin;
+  return encode_number<mrb_int, order::little>(mrb, numeric);
 }
 
 MRB_API mrb_value
 MRB_DECODE_FIX_LE(mrb_state *mrb, mrb_value bin)
 {
-  mrb_int numeric;
-
-  if (unlikely(!mrb_string_p(bin))) mrb_raise(mrb, E_TYPE_ERROR, "Not a String");
-  if (RSTRING_LEN(bin) != sizeof(numeric)) mrb_raise(mrb, E_ARGUMENT_ERROR, "Encoded Data cannot be decoded");
-
-#ifdef MRB_ENDIAN_BIG
-    const uint8_t *src = (const uint8_t *) RSTRING_PTR(bin);
-    numeric = (mrb_int) src[0];
-    for (int i = 1; i < sizeof(numeric); i++) {
-      numeric |= (mrb_int) src[i] << (8 * i);
-    }
-#else
-    memcpy(&numeric, (const uint8_t *) RSTRING_PTR(bin), sizeof(numeric));
-#endif
-
-  return mrb_int_value(mrb, numeric);
+  return mrb_int_value(mrb, decode_number<mrb_int, order::little>(mrb, bin));
 }
 
 MRB_API mrb_value
 MRB_ENCODE_FIX_BE(mrb_state *mrb, mrb_int numeric)
 {
-  mrb_value bin = mrb_str_new(mrb, NULL, sizeof(numeric));
-  mrb_gc_protect(mrb, bin);
-
-#ifdef MRB_ENDIAN_BIG
-    memcpy((uint8_t *) RSTRING_PTR(bin), &numeric, sizeof(numeric));
-#else
-    uint8_t *dst = (uint8_t *) RSTRING_PTR(bin);
-    for (int i = sizeof(numeric) -1;i > 0; i--) {
-      dst[i] = (uint8_t) numeric;
-      numeric >>= 8;
-    }
-    dst[0] = (uint8_t) numeric;
-#endif
-
-  return bin;
+  return encode_number<mrb_int, order::big>(mrb, numeric);
 }
 
 MRB_API mrb_value
 MRB_DECODE_FIX_BE(mrb_state *mrb, mrb_value bin)
 {
-  mrb_int numeric;
-
-  if (unlikely(!mrb_string_p(bin))) mrb_raise(mrb, E_TYPE_ERROR, "Not a String");
-  if (RSTRING_LEN(bin) != sizeof(numeric)) mrb_raise(mrb, E_ARGUMENT_ERROR, "Encoded Data cannot be decoded");
-
-#ifdef MRB_ENDIAN_BIG
-    memcpy(&numeric, (const uint8_t *) RSTRING_PTR(bin), sizeof(numeric));
-#else
-    const uint8_t *src = (const uint8_t *) RSTRING_PTR(bin);
-    numeric = (mrb_int) src[sizeof(numeric) - 1];
-    for (int i = sizeof(numeric) - 2; i >= 0; i--) {
-      numeric |= (mrb_int) src[i] << (sizeof(numeric) * (8 - i - 1));
-    }
-#endif
-
-  return mrb_int_value(mrb, numeric);
+  return mrb_int_value(mrb, decode_number<mrb_int, order::big>(mrb, bin));
 }
 
 #ifndef MRB_NO_FLOAT
 MRB_API mrb_value
 MRB_ENCODE_FLO_NAT(mrb_state *mrb, mrb_float numeric)
 {
-  mrb_value bin = mrb_str_new(mrb, NULL, sizeof(numeric));
-  mrb_gc_protect(mrb, bin);
-  memcpy((uint8_t *) RSTRING_PTR(bin), &numeric, sizeof(numeric));
-  return bin;
+  return encode_number<mrb_float, order::native>(mrb, numeric);
 }
 
 MRB_API mrb_value
 MRB_DECODE_FLO_NAT(mrb_state *mrb, mrb_value bin)
 {
-  mrb_float numeric;
-
-  if (unlikely(!mrb_string_p(bin))) mrb_raise(mrb, E_TYPE_ERROR, "Not a String");
-  if (RSTRING_LEN(bin) != sizeof(numeric)) mrb_raise(mrb, E_ARGUMENT_ERROR, "Encoded Data cannot be decoded");
-
-  memcpy(&numeric, (const uint8_t *) RSTRING_PTR(bin), sizeof(numeric));
-  return mrb_float_value(mrb, numeric);
+  return mrb_float_value(mrb, decode_number<mrb_float, order::native>(mrb, bin));
 }
 
 MRB_API mrb_value
 MRB_ENCODE_FLO_LE(mrb_state *mrb, mrb_float numeric)
 {
-  mrb_value bin = mrb_str_new(mrb, NULL, sizeof(numeric));
-  mrb_gc_protect(mrb, bin);
-
-#ifdef MRB_ENDIAN_BIG
-    if (unlikely(sizeof(mrb_float) != sizeof(mrb_int))) mrb_raise(mrb, E_RUNTIME_ERROR, "size of mrb_float and mrb_int differ, cannot encode floats.");
-
-    union {
-      mrb_int i;
-      mrb_float f;
-    } swap;
-
-    uint8_t *dst = (uint8_t *) RSTRING_PTR(bin);
-    swap.f = numeric;
-    for (int i = 0; i < sizeof(swap) - 1; i++) {
-      dst[i] = (uint8_t) swap.i;
-      swap.i >>= 8;
-    }
-    dst[sizeof(swap) - 1] = (uint8_t) swap.i;
-#else
-    memcpy((uint8_t *) RSTRING_PTR(bin), &numeric, sizeof(numeric));
-#endif
-
-  return bin;
+  return encode_number<mrb_float, order::little>(mrb, numeric);
 }
 
 MRB_API mrb_value
 MRB_DECODE_FLO_LE(mrb_state *mrb, mrb_value bin)
 {
-  if (unlikely(!mrb_string_p(bin))) mrb_raise(mrb, E_TYPE_ERROR, "Not a String");
-  if (RSTRING_LEN(bin) != sizeof(mrb_float)) mrb_raise(mrb, E_ARGUMENT_ERROR, "Encoded Data cannot be decoded");
-
-#ifdef MRB_ENDIAN_BIG
-    if (unlikely(sizeof(mrb_float) != sizeof(mrb_int))) mrb_raise(mrb, E_RUNTIME_ERROR, "size of mrb_float and mrb_int differ, cannot decode floats.");
-
-    union {
-      mrb_int i;
-      mrb_float f;
-    } swap;
-
-    const uint8_t *src = (const uint8_t *) RSTRING_PTR(bin);
-    swap.i = (mrb_int) src[0];
-    for (int i = 1; i < sizeof(swap); i++) {
-      swap.i |= (mrb_int) src[i] << (8 * i);
-    }
-
-    return mrb_float_value(mrb, swap.f);
-#else
-    mrb_float numeric;
-    memcpy(&numeric, (const uint8_t *) RSTRING_PTR(bin), sizeof(numeric));
-    return mrb_float_value(mrb, numeric);
-#endif
+  return mrb_float_value(mrb, decode_number<mrb_float, order::little>(mrb, bin));
 }
 
 MRB_API mrb_value
 MRB_ENCODE_FLO_BE(mrb_state *mrb, mrb_float numeric)
 {
-  mrb_value bin = mrb_str_new(mrb, NULL, sizeof(numeric));
-  mrb_gc_protect(mrb, bin);
-
-#ifdef MRB_ENDIAN_BIG
-    memcpy((uint8_t *) RSTRING_PTR(bin), &numeric, sizeof(numeric));
-#else
-    if (unlikely(sizeof(mrb_float) != sizeof(mrb_int))) mrb_raise(mrb, E_RUNTIME_ERROR, "size of mrb_float and mrb_int differ, cannot encode floats.");
-
-    union {
-      mrb_int i;
-      mrb_float f;
-    } swap;
-
-    uint8_t *dst = (uint8_t *) RSTRING_PTR(bin);
-    swap.f = numeric;
-    for (int i = sizeof(swap) -1;i > 0; i--) {
-      dst[i] = (uint8_t) swap.i;
-      swap.i >>= 8;
-    }
-    dst[0] = (uint8_t) swap.i;
-#endif
-
-  return bin;
+  return encode_number<mrb_float, order::big>(mrb, numeric);
 }
 
 MRB_API mrb_value
 MRB_DECODE_FLO_BE(mrb_state *mrb, mrb_value bin)
 {
-  if (unlikely(!mrb_string_p(bin))) mrb_raise(mrb, E_TYPE_ERROR, "Not a String");
-  if (RSTRING_LEN(bin) != sizeof(mrb_float)) mrb_raise(mrb, E_ARGUMENT_ERROR, "Encoded Data cannot be decoded");
-
-#ifdef MRB_ENDIAN_BIG
-    mrb_float numeric;
-    memcpy(&numeric, (const uint8_t *) RSTRING_PTR(bin), sizeof(numeric));
-    return mrb_float_value(mrb, numeric);
-#else
-    if (unlikely(sizeof(mrb_float) != sizeof(mrb_int))) mrb_raise(mrb, E_RUNTIME_ERROR, "size of mrb_float and mrb_int differ, cannot decode floats.");
-
-    union {
-      mrb_int i;
-      mrb_float f;
-    } swap;
-
-    const uint8_t *src = (const uint8_t *) RSTRING_PTR(bin);
-    swap.i = (mrb_int) src[sizeof(swap) - 1];
-    for (int i = sizeof(swap) - 2; i >= 0; i--) {
-      swap.i |= (mrb_int) src[i] << (sizeof(swap) * (8 - i - 1));
-    }
-
-    return mrb_float_value(mrb, swap.f);
+  return mrb_float_value(mrb, decode_number<mrb_float, order::big>(mrb, bin));
+}
 #endif
+
+#ifdef MRB_USE_BIGINT
+MRB_API mrb_value
+mrb_bint_new_bytes(mrb_state *mrb, const uint8_t *buf, size_t len, mrb_bool negative, mrb_byte_order bo)
+{
+  static const char digits[] = "0123456789abcdef";
+  const bool be = bo == MRB_BYTE_ORDER_BE;
+  // index i counts from the most significant byte
+  auto byte_at = [&](size_t i) { return be ? buf[i] : buf[len - 1 - i]; };
+
+  size_t skip = 0;
+  while (skip < len && byte_at(skip) == 0) ++skip;
+  if (skip == len) return mrb_fixnum_value(0);
+
+  // up to 512 bit fit the stack buffer, longer magnitudes get a malloc'ed scratch buffer,
+  // the digits are valid so mrb_bint_new_str can only fail on memory exhaustion
+  const size_t ndigits = (len - skip) * 2;
+  char stack_buf[128];
+  char *hex = stack_buf;
+  if (ndigits > sizeof(stack_buf)) {
+    hex = static_cast<char*>(mrb_malloc(mrb, ndigits));
+  }
+  char *p = hex;
+  for (size_t i = skip; i < len; ++i) {
+    *p++ = digits[byte_at(i) >> 4];
+    *p++ = digits[byte_at(i) & 0xf];
+  }
+  mrb_value result = mrb_bint_new_str(mrb, hex, static_cast<mrb_int>(ndigits), negative ? -16 : 16);
+  if (hex != stack_buf) mrb_free(mrb, hex);
+  return result;
 }
-#endif
\ No newline at end of file
+#endif
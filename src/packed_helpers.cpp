@@ -0,0 +1,152 @@
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/string.h>
+#include <mruby/presym.h>
+#include <mruby/num_helpers.h>
+#include <mruby/endian_codec.hpp>
+#include <mruby/bulk_convert.hpp>
+#include <mruby/mrb_value_to_cpp.hpp>
+
+namespace {
+  using mrbcpp::endian::order;
+
+  template <typename T>
+  T pack_element(mrb_state* mrb, mrb_value val) {
+    if constexpr (std::is_floating_point_v<T>) {
+      return mrbcpp::value_converter::to_floating<T>(mrb, val);
+    } else {
+      return mrbcpp::value_converter::to_integral<T>(mrb, val);
+    }
+  }
+
+  template <typename T, order O>
+  mrb_value pack_numbers(mrb_state* mrb, mrb_value ary) {
+    mrb_int len = RARRAY_LEN(ary);
+    mrb_value bin = mrb_str_new(mrb, NULL, static_cast<size_t>(len) * sizeof(T));
+    uint8_t* dst = reinterpret_cast<uint8_t*>(RSTRING_PTR(bin));
+
+    for (mrb_int i = 0; i < len; ++i) {
+      mrbcpp::endian::encode<T, O>(dst + i * sizeof(T), pack_element<T>(mrb, RARRAY_PTR(ary)[i]));
+    }
+
+    return bin;
+  }
+
+  template <typename T, order O>
+  mrb_value unpack_numbers(mrb_state* mrb, mrb_value bin) {
+    const size_t total = static_cast<size_t>(RSTRING_LEN(bin));
+    if (unlikely(total % sizeof(T) != 0)) {
+      mrb_raisef(mrb, E_ARGUMENT_ERROR, "string size must be a multiple of %d bytes", static_cast<int>(sizeof(T)));
+    }
+    const size_t count = total / sizeof(T);
+    mrb_value ary = mrb_ary_new_capa(mrb, static_cast<mrb_int>(count));
+
+    // decode into a stack buffer and box a chunk at a time
+    T chunk[256];
+    for (size_t i = 0; i < count; i += 256) {
+      size_t n = count - i < 256 ? count - i : 256;
+      const char* src = RSTRING_PTR(bin) + i * sizeof(T);
+      for (size_t j = 0; j < n; ++j) {
+        chunk[j] = mrbcpp::endian::decode<T, O>(src + j * sizeof(T));
+      }
+      mrb_ary_push_numbers(mrb, ary, chunk, n);
+    }
+
+    return ary;
+  }
+
+  template <template <typename, order> class F>
+  mrb_value dispatch(mrb_state* mrb, mrb_num_type type, mrb_byte_order bo, mrb_value arg) {
+    const bool be = bo == MRB_BYTE_ORDER_BE;
+    switch (type) {
+      case MRB_NUM_I8:  return F<int8_t, order::native>::call(mrb, arg);
+      case MRB_NUM_U8:  return F<uint8_t, order::native>::call(mrb, arg);
+      case MRB_NUM_I16: return be ? F<int16_t, order::big>::call(mrb, arg)  : F<int16_t, order::little>::call(mrb, arg);
+      case MRB_NUM_U16: return be ? F<uint16_t, order::big>::call(mrb, arg) : F<uint16_t, order::little>::call(mrb, arg);
+      case MRB_NUM_I32: return be ? F<int32_t, order::big>::call(mrb, arg)  : F<int32_t, order::little>::call(mrb, arg);
+      case MRB_NUM_U32: return be ? F<uint32_t, order::big>::call(mrb, arg) : F<uint32_t, order::little>::call(mrb, arg);
+      case MRB_NUM_I64: return be ? F<int64_t, order::big>::call(mrb, arg)  : F<int64_t, order::little>::call(mrb, arg);
+      case MRB_NUM_U64: return be ? F<uint64_t, order::big>::call(mrb, arg) : F<uint64_t, order::little>::call(mrb, arg);
+#ifndef MRB_NO_FLOAT
+      case MRB_NUM_F32: return be ? F<float, order::big>::call(mrb, arg)    : F<float, order::little>::call(mrb, arg);
+      case MRB_NUM_F64: return be ? F<double, order::big>::call(mrb, arg)   : F<double, order::little>::call(mrb, arg);
+#endif
+      default: mrb_raise(mrb, E_ARGUMENT_ERROR, "unsupported number type");
+    }
+  }
+
+  template <typename T, order O>
+  struct pack_fn {
+    static mrb_value call(mrb_state* mrb, mrb_value ary) { return pack_numbers<T, O>(mrb, ary); }
+  };
+
+  template <typename T, order O>
+  struct unpack_fn {
+    static mrb_value call(mrb_state* mrb, mrb_value bin) { return unpack_numbers<T, O>(mrb, bin); }
+  };
+}
+
+MRB_API mrb_num_type
+mrb_num_type_from_sym(mrb_state *mrb, mrb_sym type)
+{
+  switch (type) {
+    case MRB_SYM(i8):  return MRB_NUM_I8;
+    case MRB_SYM(u8):  return MRB_NUM_U8;
+    case MRB_SYM(i16): return MRB_NUM_I16;
+    case MRB_SYM(u16): return MRB_NUM_U16;
+    case MRB_SYM(i32): return MRB_NUM_I32;
+    case MRB_SYM(u32): return MRB_NUM_U32;
+    case MRB_SYM(i64): return MRB_NUM_I64;
+    case MRB_SYM(u64): return MRB_NUM_U64;
+    case MRB_SYM(f32): return MRB_NUM_F32;
+    case MRB_SYM(f64): return MRB_NUM_F64;
+    case MRB_SYM(i128): return MRB_NUM_I128;
+    case MRB_SYM(u128): return MRB_NUM_U128;
+    default:
+      mrb_raisef(mrb, E_ARGUMENT_ERROR, "unknown number type :%n, expected one of :i8, :u8, :i16, :u16, :i32, :u32, :i64, :u64, :f32, :f64, :i128, :u128", type);
+  }
+}
+
+MRB_API mrb_byte_order
+mrb_byte_order_from_sym(mrb_state *mrb, mrb_sym sym)
+{
+  switch (sym) {
+    case MRB_SYM(le):
+    case MRB_SYM(little):
+      return MRB_BYTE_ORDER_LE;
+    case MRB_SYM(be):
+    case MRB_SYM(big):
+      return MRB_BYTE_ORDER_BE;
+    case MRB_SYM(native):
+      return order::native == order::big ? MRB_BYTE_ORDER_BE : MRB_BYTE_ORDER_LE;
+    default:
+      mrb_raisef(mrb, E_ARGUMENT_ERROR, "unknown byte order :%n, expected :le, :be or :native", sym);
+  }
+}
+
+MRB_API size_t
+mrb_num_type_width(mrb_num_type type)
+{
+  static const size_t widths[] = {1, 1, 2, 2, 4, 4, 8, 8, 4, 8, 16, 16};
+  return widths[type];
+}
+
+MRB_API mrb_value
+mrb_pack_numbers(mrb_state *mrb, mrb_value ary, mrb_num_type type, mrb_byte_order bo)
+{
+  if (unlikely(!mrb_array_p(ary))) mrb_raise(mrb, E_TYPE_ERROR, "Not an Array");
+  return dispatch<pack_fn>(mrb, type, bo, ary);
+}
+
+MRB_API mrb_value
+mrb_unpack_numbers(mrb_state *mrb, mrb_value bin, mrb_num_type type, mrb_byte_order bo)
+{
+  if (unlikely(!mrb_string_p(bin))) mrb_raise(mrb, E_TYPE_ERROR, "Not a String");
+  return dispatch<unpack_fn>(mrb, type, bo, bin);
+}
+
+MRB_API mrb_bool
+mrb_bswap_buffer(void *buf, size_t count, size_t width)
+{
+  return mrbcpp::endian::bswap_buffer(buf, count, width);
+}
@@ -0,0 +1,138 @@
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/string.h>
+#include <mruby/num_helpers.h>
+#include <mruby/endian_codec.hpp>
+#include <mruby/bulk_convert.hpp>
+#include <mruby/mrb_value_to_cpp.hpp>
+#include <cstring>
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+  // Gathers the low 7 bits of each byte of x into one number
+  inline uint64_t compact_7bit_groups(uint64_t x) {
+#if defined(__BMI2__)
+    return _pext_u64(x, 0x7f7f7f7f7f7f7f7fULL);
+#else
+    return  (x & 0x000000000000007fULL)
+         | ((x & 0x0000000000007f00ULL) >> 1)
+         | ((x & 0x00000000007f0000ULL) >> 2)
+         | ((x & 0x000000007f000000ULL) >> 3)
+         | ((x & 0x0000007f00000000ULL) >> 4)
+         | ((x & 0x00007f0000000000ULL) >> 5)
+         | ((x & 0x007f000000000000ULL) >> 6)
+         | ((x & 0x7f00000000000000ULL) >> 7);
+#endif
+  }
+
+  size_t varint_decode_slow(const uint8_t* buf, size_t len, uint64_t* value) {
+    uint64_t result = 0;
+    size_t max = len < MRB_VARINT_MAX_LEN ? len : MRB_VARINT_MAX_LEN;
+    for (size_t i = 0; i < max; ++i) {
+      uint8_t byte = buf[i];
+      // the 10th byte only carries the top bit of a uint64_t
+      if (unlikely(i == MRB_VARINT_MAX_LEN - 1 && byte > 1)) return 0;
+      result |= static_cast<uint64_t>(byte & 0x7f) << (7 * i);
+      if (!(byte & 0x80)) {
+        *value = result;
+        return i + 1;
+      }
+    }
+    return 0;
+  }
+
+  template <bool ZigZag>
+  mrb_value varint_unpack(mrb_state* mrb, mrb_value bin) {
+    using T = std::conditional_t<ZigZag, int64_t, uint64_t>;
+    mrb_value ary = mrb_ary_new(mrb);
+    const size_t len = static_cast<size_t>(RSTRING_LEN(bin));
+    size_t pos = 0;
+
+    // decode into a stack buffer and box a chunk at a time
+    T chunk[256];
+    while (pos < len) {
+      size_t n = 0;
+      while (n < 256 && pos < len) {
+        uint64_t v;
+        size_t used = mrb_varint_decode(reinterpret_cast<const uint8_t*>(RSTRING_PTR(bin)) + pos, len - pos, &v);
+        if (unlikely(used == 0)) mrb_raise(mrb, E_ARGUMENT_ERROR, "truncated or overlong varint");
+        if constexpr (ZigZag) {
+          chunk[n++] = mrb_zigzag_decode(v);
+        } else {
+          chunk[n++] = v;
+        }
+        pos += used;
+      }
+      mrb_ary_push_numbers(mrb, ary, chunk, n);
+    }
+
+    return ary;
+  }
+}
+
+MRB_API size_t
+mrb_varint_encode(uint64_t value, uint8_t *buf)
+{
+  size_t i = 0;
+  while (value >= 0x80) {
+    buf[i++] = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  buf[i++] = static_cast<uint8_t>(value);
+  return i;
+}
+
+// Reads 8 bytes at once when possible, the first byte with a clear high bit ends the
+// varint, its position comes from a count trailing zeros and the payload bits are
+// gathered without a per byte loop. Only 9 and 10 byte varints and the tail of the
+// buffer take the bytewise path.
+MRB_API size_t
+mrb_varint_decode(const uint8_t *buf, size_t len, uint64_t *value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  if (likely(len >= 8)) {
+    uint64_t word;
+    std::memcpy(&word, buf, sizeof(word));
+    if constexpr (mrbcpp::endian::order::native == mrbcpp::endian::order::big) {
+      word = mrbcpp::endian::bswap(word);
+    }
+    uint64_t stops = ~word & 0x8080808080808080ULL;
+    if (likely(stops != 0)) {
+      size_t bytes = static_cast<size_t>(__builtin_ctzll(stops)) / 8 + 1;
+      uint64_t mask = bytes == 8 ? ~0ULL : (1ULL << (8 * bytes)) - 1;
+      *value = compact_7bit_groups(word & mask);
+      return bytes;
+    }
+  }
+#endif
+  return varint_decode_slow(buf, len, value);
+}
+
+MRB_API uint64_t
+mrb_varint_value(mrb_state *mrb, mrb_value num, mrb_bool zigzag)
+{
+  if (zigzag) {
+    return mrb_zigzag_encode(mrbcpp::value_converter::to_integral<int64_t>(mrb, num));
+  }
+  if (mrb_integer_p(num) && mrb_integer(num) < 0) {
+    return static_cast<uint64_t>(static_cast<int64_t>(mrb_integer(num)));
+  }
+  return mrbcpp::value_converter::to_integral<uint64_t>(mrb, num);
+}
+
+MRB_API mrb_value
+mrb_varint_pack(mrb_state *mrb, mrb_value num, mrb_bool zigzag)
+{
+  uint8_t buf[MRB_VARINT_MAX_LEN];
+  size_t len = mrb_varint_encode(mrb_varint_value(mrb, num, zigzag), buf);
+  return mrb_str_new(mrb, reinterpret_cast<const char*>(buf), len);
+}
+
+MRB_API mrb_value
+mrb_varint_unpack(mrb_state *mrb, mrb_value bin, mrb_bool zigzag)
+{
+  if (unlikely(!mrb_string_p(bin))) mrb_raise(mrb, E_TYPE_ERROR, "Not a String");
+  return zigzag ? varint_unpack<true>(mrb, bin) : varint_unpack<false>(mrb, bin);
+}
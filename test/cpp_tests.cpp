@@ -6,6 +6,7 @@
 #include <mruby/presym.h>
 #include <mruby/string.h>
 #include <cassert>
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <array>
@@ -15,10 +16,19 @@
 #include <unordered_set>
 #include <chrono>
 #include <any>
+#include <optional>
+#include <mruby/num_helpers.h>
 #include <mruby/cpp_to_mrb_value.hpp>
 #include <mruby/mrb_value_to_cpp.hpp>
+#include <mruby/mrb_string_view.hpp>
 #include <mruby/cpp_helpers.hpp>
+#include <mruby/mrb_value_visit.hpp>
+#include <mruby/converter_context.hpp>
+#include <mruby/cpp_describe.hpp>
+#include <mruby/key_table.hpp>
+#include <mruby/cpp_method.hpp>
 #include <mruby/compile.h>
+#include <mruby/error.h>
 
 static void run_value_to_cpp_tests(mrb_state* mrb) {
   // --- Scalars ---
@@ -70,12 +80,193 @@ static void run_value_to_cpp_tests(mrb_state* mrb) {
   auto map_out = std::any_cast<std::map<MapKey,std::any>>(ah);
   assert(std::any_cast<mrb_int>(map_out[std::string("a")]) == 1);
 
+  mrb_value ordered = mrb_load_string(mrb, "{'b' => 2, 'a' => 1, :a => 3}");
+  auto umap_out = mrb_hash_to_unordered_map(mrb, ordered);
+  assert(umap_out.size() == 2 && std::any_cast<mrb_int>(umap_out[std::string("a")]) == 1);
+  auto pairs = mrb_hash_to_pairs(mrb, ordered);
+  assert(pairs.size() == 3 && std::get<std::string>(pairs[0].first) == "b");
+  auto sorted = mrb_hash_to_sorted_pairs(mrb, ordered);
+  assert(sorted.size() == 2 && std::get<std::string>(sorted[0].first) == "a");
+  assert(std::any_cast<mrb_int>(sorted[0].second) == 1);
+
   // --- Set ---
   // needs 'set' library loaded in mruby
   mrb_value ruby_set = mrb_load_string(mrb, "Set['x', 'y']");
   std::any aset = mrb_value_to_any(mrb, ruby_set);
   auto set_vec = std::any_cast<std::vector<std::any>>(aset);
   assert(set_vec.size() == 2);
+
+  // --- Deep nesting, cycles and shared objects ---
+  mrb_value deep = mrb_load_string(mrb, "d = []; 10_000.times { d = [d] }; d");
+  mrb_any_options unlimited;
+  unlimited.max_depth = 0;
+  std::any adeep = mrb_value_to_any(mrb, deep, unlimited);
+  // by pointer, a copy of the result would recurse 10_000 levels deep
+  assert(std::any_cast<std::vector<std::any>>(&adeep)->size() == 1);
+
+  mrb_bool too_deep = FALSE;
+  mrb_protect_error(mrb, [](mrb_state* mrb, void* data) -> mrb_value {
+    mrb_value_to_any(mrb, *static_cast<mrb_value*>(data));
+    return mrb_nil_value();
+  }, &deep, &too_deep);
+  assert(too_deep);
+
+  too_deep = FALSE;
+  mrb_protect_error(mrb, [](mrb_state* mrb, void* data) -> mrb_value {
+    mrb_any_options opts;
+    opts.max_depth = 100;
+    mrb_value_to_any(mrb, *static_cast<mrb_value*>(data), opts);
+    return mrb_nil_value();
+  }, &deep, &too_deep);
+  assert(too_deep);
+
+  mrb_value cyclic = mrb_load_string(mrb, "c = [1]; c << c; c");
+  mrb_bool failed = FALSE;
+  mrb_protect_error(mrb, [](mrb_state* mrb, void* data) -> mrb_value {
+    mrb_value_to_any(mrb, *static_cast<mrb_value*>(data));
+    return mrb_nil_value();
+  }, &cyclic, &failed);
+  assert(failed);
+
+  mrb_value shared = mrb_load_string(mrb, "s = ['x']; [s, s]");
+  mrb_any_options share;
+  share.share = true;
+  auto ashared = std::any_cast<std::shared_ptr<std::vector<std::any>>>(mrb_value_to_any(mrb, shared, share));
+  auto first = std::any_cast<std::shared_ptr<std::vector<std::any>>>((*ashared)[0]);
+  auto second = std::any_cast<std::shared_ptr<std::vector<std::any>>>((*ashared)[1]);
+  assert(first.get() == second.get());
+
+#ifdef MRB_USE_SET
+  // Set#to_a may run ruby code, the entries not converted yet must survive it
+  mrb_value mutated = mrb_load_string(mrb,
+    "class ClearingSet < Set; def to_a; $h.clear; GC.start; super; end; end;"
+    "$h = {a: ClearingSet[1], b: 'x' * 100, c: [1, 2]}");
+  auto amutated = std::any_cast<std::map<MapKey, std::any>>(mrb_value_to_any(mrb, mutated));
+  assert(std::any_cast<const std::string&>(amutated.at(std::string("b"))).size() == 100);
+  assert(std::any_cast<const std::vector<std::any>&>(amutated.at(std::string("c"))).size() == 2);
+
+  // the Array being converted is only referenced from the cleared Hash
+  mrb_value nested_set = mrb_load_string(mrb, "$h = {a: [ClearingSet[1], 'y' * 100]}");
+  auto anested = std::any_cast<std::map<MapKey, std::any>>(mrb_value_to_any(mrb, nested_set));
+  const auto& inner = std::any_cast<const std::vector<std::any>&>(anested.at(std::string("a")));
+  assert(inner.size() == 2);
+  assert(std::any_cast<const std::vector<std::any>&>(inner[0]).size() == 1);
+  assert(std::any_cast<const std::string&>(inner[1]).size() == 100);
+#endif
+}
+
+static void run_typed_value_to_cpp_tests(mrb_state* mrb) {
+  // --- Scalars ---
+  assert(mrb_value_to_cpp<int32_t>(mrb, mrb_load_string(mrb, "42")) == 42);
+  assert(mrb_value_to_cpp<uint8_t>(mrb, mrb_load_string(mrb, "255")) == 255);
+  assert(std::abs(mrb_value_to_cpp<double>(mrb, mrb_load_string(mrb, "2.5")) - 2.5) < 1e-9);
+  assert(mrb_value_to_cpp<double>(mrb, mrb_load_string(mrb, "2")) == 2.0);
+  assert(mrb_value_to_cpp<bool>(mrb, mrb_load_string(mrb, "true")));
+  assert(mrb_value_to_cpp<std::string>(mrb, mrb_load_string(mrb, "'hi'")) == "hi");
+  assert(mrb_value_to_cpp<std::string>(mrb, mrb_load_string(mrb, ":sym")) == "sym");
+
+  // --- Containers ---
+  auto ints = mrb_value_to_cpp<std::vector<int32_t>>(mrb, mrb_load_string(mrb, "[1, 2, 3]"));
+  assert((ints == std::vector<int32_t>{1, 2, 3}));
+
+  mrb_value point = mrb_load_string(mrb, "Struct.new(:x, :y).new(7, 8)");
+  auto from_struct = mrb_value_to_cpp<std::vector<int32_t>>(mrb, point);
+  assert((from_struct == std::vector<int32_t>{7, 8}));
+  assert(mrb_value_to_cpp<std::vector<std::string>>(mrb, mrb_load_string(mrb, "Struct.new(:a).new('s')"))[0] == "s");
+
+  auto fixed = mrb_value_to_cpp<std::array<int, 2>>(mrb, mrb_load_string(mrb, "[4, 5]"));
+  assert(fixed[0] == 4 && fixed[1] == 5);
+
+  auto umap = mrb_value_to_cpp<std::unordered_map<std::string, double>>(mrb,
+    mrb_load_string(mrb, "{'a' => 1.5, 'b' => 2}"));
+  assert(umap.size() == 2 && umap["a"] == 1.5 && umap["b"] == 2.0);
+
+  auto kv = mrb_value_to_cpp<std::vector<std::pair<std::string, int>>>(mrb, mrb_load_string(mrb, "{'z' => 1, 'y' => 2}"));
+  assert(kv.size() == 2 && kv[0].first == "z" && kv[1].second == 2);
+
+  auto nested = mrb_value_to_cpp<std::map<std::string, std::vector<std::string>>>(mrb,
+    mrb_load_string(mrb, "{'x' => ['a', 'b']}"));
+  assert(nested["x"][1] == "b");
+
+  auto sset = mrb_value_to_cpp<std::set<int>>(mrb, mrb_load_string(mrb, "Set[3, 1, 2]"));
+  assert(sset.size() == 3 && *sset.begin() == 1);
+
+#if defined(__SIZEOF_INT128__)
+  // --- 128 bit from plain Integers, signedness must not depend on gnu++ extensions ---
+  assert(mrb_value_to_cpp<__int128>(mrb, mrb_fixnum_value(-7)) == -7);
+  assert(mrb_value_to_cpp<__int128>(mrb, mrb_int_value(mrb, MRB_INT_MIN)) == MRB_INT_MIN);
+  assert(mrb_value_to_cpp<unsigned __int128>(mrb, mrb_fixnum_value(7)) == 7);
+  mrb_value i128 = mrb_encode_number(mrb, mrb_fixnum_value(-7), MRB_NUM_I128, MRB_BYTE_ORDER_LE);
+  assert(RSTRING_LEN(i128) == 16 && static_cast<unsigned char>(RSTRING_PTR(i128)[15]) == 0xff);
+  assert(mrb_integer(mrb_decode_number(mrb, i128, MRB_NUM_I128, MRB_BYTE_ORDER_LE)) == -7);
+#endif
+
+  // --- Optional ---
+  assert(!mrb_value_to_cpp<std::optional<int>>(mrb, mrb_nil_value()).has_value());
+  assert(mrb_value_to_cpp<std::optional<int>>(mrb, mrb_fixnum_value(7)).value() == 7);
+
+  // --- Range and type errors ---
+  mrb_bool error;
+  mrb_value too_big = mrb_fixnum_value(300);
+  mrb_protect_error(mrb, [](mrb_state* mrb, void* ud) -> mrb_value {
+    mrb_value_to_cpp<uint8_t>(mrb, *static_cast<mrb_value*>(ud));
+    return mrb_nil_value();
+  }, &too_big, &error);
+  assert(error);
+
+#if defined(__SIZEOF_INT128__)
+  mrb_value negative = mrb_fixnum_value(-1);
+  mrb_protect_error(mrb, [](mrb_state* mrb, void* ud) -> mrb_value {
+    mrb_value_to_cpp<unsigned __int128>(mrb, *static_cast<mrb_value*>(ud));
+    return mrb_nil_value();
+  }, &negative, &error);
+  assert(error);
+#endif
+
+  mrb_value not_array = mrb_str_new_lit(mrb, "nope");
+  mrb_protect_error(mrb, [](mrb_state* mrb, void* ud) -> mrb_value {
+    mrb_value_to_cpp<std::vector<int>>(mrb, *static_cast<mrb_value*>(ud));
+    return mrb_nil_value();
+  }, &not_array, &error);
+  assert(error);
+}
+
+static void run_string_view_tests(mrb_state* mrb) {
+  mrb_value s = mrb_str_new_lit(mrb, "borrowed\0bytes");
+  {
+    mrb_str_borrow guard(mrb, s, mrb_pin::root);
+    assert(guard.data() == RSTRING_PTR(s));
+    assert(guard.view() == std::string_view("borrowed\0bytes", 14));
+    assert(guard.bytes().size() == 14);
+    assert(guard.bytes()[8] == std::byte{0});
+  }
+
+  std::string_view sym = mrb_str_view(mrb, mrb_symbol_value(mrb_intern_lit(mrb, "name")));
+  assert(sym == "name");
+
+  std::string_view typed = mrb_value_to_cpp<std::string_view>(mrb, s);
+  assert(typed.data() == RSTRING_PTR(s));
+
+  auto keys = mrb_value_to_cpp<std::vector<std::string_view>>(mrb, mrb_load_string(mrb, "['a', 'bc']"));
+  assert(keys.size() == 2 && keys[0] == "a" && keys[1] == "bc");
+
+  // short Symbol names share one scratch buffer, borrowed views of them must not alias
+  {
+    mrb_str_borrow a(mrb, mrb_symbol_value(mrb_intern_lit(mrb, "a")));
+    mrb_str_borrow bc(mrb, mrb_symbol_value(mrb_intern_lit(mrb, "bc")));
+    assert(a.view() == "a" && bc.view() == "bc");
+    assert(mrb_string_p(a.value()));
+  }
+
+  mrb_bool error;
+  mrb_value syms = mrb_load_string(mrb, "[:a, :bc]");
+  mrb_protect_error(mrb, [](mrb_state* mrb, void* ud) -> mrb_value {
+    mrb_value_to_cpp<std::vector<std::string_view>>(mrb, *static_cast<mrb_value*>(ud));
+    return mrb_nil_value();
+  }, &syms, &error);
+  assert(error);
+  auto names = mrb_value_to_cpp<std::vector<std::string>>(mrb, syms);
+  assert(names.size() == 2 && names[0] == "a" && names[1] == "bc");
 }
 
 static void run_cpp_to_mrb_tests(mrb_state* mrb) {
@@ -124,6 +315,10 @@ static void run_cpp_to_mrb_tests(mrb_state* mrb) {
     std::unordered_set<std::string> uset = {"foo","bar"};
     mrb_value uset_val = cpp_to_mrb_value(mrb, uset);
     assert(mrb_obj_is_kind_of(mrb, uset_val, set_cls));
+    assert(mrb_integer(mrb_funcall_id(mrb, uset_val, MRB_SYM(size), 0)) == 2);
+    assert(mrb_test(mrb_funcall_id(mrb, uset_val, MRB_SYM_Q(include), 1, mrb_str_new_lit(mrb, "foo"))));
+    auto uset_back = mrb_value_to_cpp<std::unordered_set<std::string>>(mrb, uset_val);
+    assert(uset_back == uset);
 
     // --- iterable containers ---
     std::vector<int> v = {1,2,3};
@@ -134,6 +329,76 @@ static void run_cpp_to_mrb_tests(mrb_state* mrb) {
     mrb_value aval = cpp_to_mrb_value(mrb, arr);
     assert(mrb_type(aval) == MRB_TT_ARRAY);
 
+    // --- contiguous numbers ---
+    std::vector<int64_t> wide = {1, MRB_FIXNUM_MAX, -2, MRB_FIXNUM_MIN, std::numeric_limits<int64_t>::max()};
+    mrb_value wval = cpp_to_mrb_value(mrb, wide);
+    assert(RARRAY_LEN(wval) == static_cast<mrb_int>(wide.size()));
+    assert(mrb_fixnum(mrb_ary_ref(mrb, wval, 1)) == MRB_FIXNUM_MAX);
+    assert(mrb_fixnum(mrb_ary_ref(mrb, wval, 3)) == MRB_FIXNUM_MIN);
+    assert(mrb_value_to_cpp<std::vector<int64_t>>(mrb, wval) == wide);
+
+#ifdef MRB_USE_BIGINT
+    std::array<uint64_t, 3> uarr = {0, 7, std::numeric_limits<uint64_t>::max()};
+    mrb_value u64val = cpp_to_mrb_value(mrb, uarr);
+    assert(mrb_bigint_p(mrb_ary_ref(mrb, u64val, 2)));
+    assert(mrb_value_to_cpp<std::vector<uint64_t>>(mrb, u64val)[2] == uarr[2]);
+
+    // Bigints come out as native 128 bit numbers, or sign and magnitude bytes when bigger
+#if defined(__SIZEOF_INT128__)
+    std::any a70 = mrb_value_to_any(mrb, mrb_load_string(mrb, "-(2**70)"));
+    assert(std::any_cast<__int128>(a70) == -(static_cast<__int128>(1) << 70));
+    std::any a127 = mrb_value_to_any(mrb, mrb_load_string(mrb, "2**127"));
+    assert(std::any_cast<unsigned __int128>(a127) == static_cast<unsigned __int128>(1) << 127);
+    assert(mrb_value_to_cpp<unsigned __int128>(mrb, mrb_load_string(mrb, "2**100 + 5")) ==
+           ((static_cast<unsigned __int128>(1) << 100) + 5));
+    assert(mrb_value_to_cpp<__int128>(mrb, mrb_load_string(mrb, "-(2**127)")) ==
+           static_cast<__int128>(static_cast<unsigned __int128>(1) << 127));
+    // within 64 bits the magnitude is read directly, right at and past the edges it is not
+    assert(std::any_cast<__int128>(mrb_value_to_any(mrb, mrb_load_string(mrb, "2**64 - 1"))) ==
+           static_cast<__int128>(std::numeric_limits<uint64_t>::max()));
+    assert(std::any_cast<__int128>(mrb_value_to_any(mrb, mrb_load_string(mrb, "2**64"))) ==
+           static_cast<__int128>(1) << 64);
+    assert(std::any_cast<__int128>(mrb_value_to_any(mrb, mrb_load_string(mrb, "-(2**64) - 1"))) ==
+           -(static_cast<__int128>(1) << 64) - 1);
+    assert(mrb_bint_to_big_integer(mrb, mrb_load_string(mrb, "2**63 + 0x102")).magnitude ==
+           std::string("\x02\x01\0\0\0\0\0\x80", 8));
+#endif
+    std::any a200 = mrb_value_to_any(mrb, mrb_load_string(mrb, "-(2**200 + 0xab)"));
+    const mrb_big_integer& big = std::any_cast<const mrb_big_integer&>(a200);
+    assert(big.negative && big.magnitude.size() == 26);
+    assert(static_cast<unsigned char>(big.magnitude[0]) == 0xab && big.magnitude[25] == 1);
+
+    // built in one step from limbs or bytes, equal to what ruby computes
+    const uint8_t be_bytes[] = {0, 0, 0x10, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xab};
+    mrb_value from_bytes = mrb_bint_new_bytes(mrb, be_bytes, sizeof(be_bytes), TRUE, MRB_BYTE_ORDER_BE);
+    assert(mrb_equal(mrb, from_bytes, mrb_load_string(mrb, "-(2**96 + 0xab)")));
+    assert(mrb_integer(mrb_bint_new_bytes(mrb, be_bytes + 14, 1, FALSE, MRB_BYTE_ORDER_LE)) == 0xab);
+#if defined(__SIZEOF_INT128__)
+    assert(mrb_equal(mrb, mrb_convert_number(mrb, (static_cast<unsigned __int128>(3) << 100) | 7),
+                     mrb_load_string(mrb, "3 * 2**100 + 7")));
+    __int128 int128_min = static_cast<__int128>(static_cast<unsigned __int128>(1) << 127);
+    assert(mrb_equal(mrb, mrb_convert_number(mrb, int128_min), mrb_load_string(mrb, "-(2**127)")));
+#endif
+
+    auto big_keys = mrb_hash_to_map(mrb, mrb_load_string(mrb, "{ 2**80 => 1, -(2**80) => 2, 2**90 => 3 }"));
+    assert(big_keys.size() == 3);
+    assert(std::any_cast<mrb_int>(big_keys.begin()->second) == 2);
+    assert(std::any_cast<mrb_int>(big_keys.rbegin()->second) == 3);
+
+    auto mixed = mrb_hash_to_sorted_pairs(mrb, mrb_load_string(mrb, "{ 2**80 => 1, 5 => 2, -(2**80) => 3, 'k' => 4, 1.5 => 5 }"));
+    assert(mixed.size() == 5);
+    assert(std::any_cast<mrb_int>(mixed[0].second) == 3 && std::any_cast<mrb_int>(mixed[1].second) == 2);
+    assert(std::any_cast<mrb_int>(mixed[2].second) == 1 && std::any_cast<mrb_int>(mixed[3].second) == 5);
+    assert(std::any_cast<mrb_int>(mixed[4].second) == 4);
+    assert(std::is_sorted(mixed.begin(), mixed.end(), [](const auto& a, const auto& b) {
+      return mrb_map_key_less()(a.first, b.first);
+    }));
+#endif
+
+    std::vector<double> dv = {0.5, -1.25};
+    mrb_value dval = cpp_to_mrb_value(mrb, dv);
+    assert(mrb_value_to_cpp<std::vector<double>>(mrb, dval) == dv);
+
     // --- time_point ---
     auto now = system_clock::now();
     mrb_value tval = cpp_to_mrb_value(mrb, now);
@@ -284,6 +549,192 @@ void test_edges(mrb_state* mrb) {
   }
 }
 
+// Writes a compact JSON like string
+struct JsonishVisitor : mrb_value_visitor<JsonishVisitor> {
+  std::string out;
+  std::vector<bool> first{true};
+
+  void sep() {
+    if (!first.back()) out += ',';
+    first.back() = false;
+  }
+  void on_nil() { sep(); out += "null"; }
+  void on_bool(bool b) { sep(); out += b ? "true" : "false"; }
+  void on_int(mrb_int i) { sep(); out += std::to_string(i); }
+  void on_float(mrb_float f) { sep(); out += std::to_string(f); }
+  void on_string(std::string_view s) { sep(); out += '"'; out += s; out += '"'; }
+  void begin_array(mrb_int) { sep(); out += '['; first.push_back(true); }
+  void end_array() { out += ']'; first.pop_back(); }
+  void begin_map(mrb_int) { sep(); out += '{'; first.push_back(true); }
+  void key(std::string_view k) { on_string(k); out += ':'; first.back() = true; }
+  void end_map() { out += '}'; first.pop_back(); }
+};
+
+static void run_visitor_tests(mrb_state* mrb) {
+  JsonishVisitor v;
+  mrb_value val = mrb_load_string(mrb, "{'a' => [1, nil, true], :b => {'c' => 'd'}, 'e' => Struct.new(:x).new(2)}");
+  mrb_value_visit(mrb, val, v);
+  assert(v.out == "{\"a\":[1,null,true],\"b\":{\"c\":\"d\"},\"e\":[2]}");
+
+  JsonishVisitor s;
+  mrb_value_visit(mrb, mrb_load_string(mrb, "Set[1]"), s);
+  assert(s.out == "[1]");
+
+  // a symbol lookup in the callback must not overwrite the name being visited
+  struct SymbolVisitor : mrb_value_visitor<SymbolVisitor> {
+    mrb_state* mrb;
+    std::vector<std::string> seen;
+    explicit SymbolVisitor(mrb_state* mrb) : mrb(mrb) {}
+    void on_string(std::string_view s) {
+      mrb_sym_name_len(mrb, mrb_intern_lit(mrb, "zz"), nullptr);
+      seen.emplace_back(s);
+    }
+    void key(std::string_view k) { on_string(k); }
+  } sv(mrb);
+  mrb_value_visit(mrb, mrb_load_string(mrb, "{abc: :de}"), sv);
+  assert((sv.seen == std::vector<std::string>{"abc", "de"}));
+
+  mrb_value cyclic = mrb_load_string(mrb, "a = [1]; a << {k: a}; a");
+  mrb_bool failed = FALSE;
+  mrb_protect_error(mrb, [](mrb_state* mrb, void* data) -> mrb_value {
+    JsonishVisitor c;
+    mrb_value_visit(mrb, *static_cast<mrb_value*>(data), c);
+    return mrb_nil_value();
+  }, &cyclic, &failed);
+  assert(failed);
+
+  mrb_value deep = mrb_load_string(mrb, "d = []; 100.times { d = [d] }; d");
+  failed = FALSE;
+  mrb_protect_error(mrb, [](mrb_state* mrb, void* data) -> mrb_value {
+    JsonishVisitor c;
+    mrb_value_visit(mrb, *static_cast<mrb_value*>(data), c, 50);
+    return mrb_nil_value();
+  }, &deep, &failed);
+  assert(failed);
+  JsonishVisitor d;
+  mrb_value_visit(mrb, deep, d);
+  assert(d.out.size() == 2 * 101);
+
+  // the same Array twice is fine, only containers being visited count
+  JsonishVisitor twice;
+  mrb_value_visit(mrb, mrb_load_string(mrb, "x = [1]; [x, x]"), twice);
+  assert(twice.out == "[[1],[1]]");
+}
+
+struct DescribedPoint {
+  double x;
+  double y;
+  std::string label;
+};
+
+MRB_CPP_DESCRIBE(DescribedPoint, x, y, label)
+
+static void run_describe_tests(mrb_state* mrb) {
+  DescribedPoint p{1.5, -2.0, "origin"};
+  mrb_value v = cpp_to_mrb_value(mrb, p);
+  assert(mrb_type(v) == MRB_TT_STRUCT);
+  assert(mrb_float(mrb_funcall_id(mrb, v, MRB_SYM(x), 0)) == 1.5);
+  mrb_value label = mrb_funcall_id(mrb, v, MRB_SYM(label), 0);
+  assert(mrb_str_view(mrb, label) == "origin");
+
+  // the Struct class is created once
+  mrb_value v2 = cpp_to_mrb_value(mrb, DescribedPoint{0, 0, ""});
+  assert(mrb_obj_class(mrb, v) == mrb_obj_class(mrb, v2));
+
+  // members are filled in by position, Struct#initialize isn't called
+  mrb_define_method(mrb, mrb_obj_class(mrb, v), "initialize", [](mrb_state* mrb, mrb_value) -> mrb_value {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "initialize called");
+  }, MRB_ARGS_ANY());
+  mrb_value v3 = cpp_to_mrb_value(mrb, p);
+  assert(mrb_equal(mrb, v, v3));
+  assert(RARRAY_LEN(mrb_funcall_id(mrb, v3, MRB_SYM(to_a), 0)) == 3);
+
+  auto back = mrb_value_to_cpp<DescribedPoint>(mrb, v);
+  assert(back.x == 1.5 && back.y == -2.0 && back.label == "origin");
+
+  auto from_hash = mrb_value_to_cpp<DescribedPoint>(mrb, mrb_load_string(mrb, "{x: 3.0, y: 4, label: 'h'}"));
+  assert(from_hash.x == 3.0 && from_hash.y == 4.0 && from_hash.label == "h");
+
+  std::vector<DescribedPoint> points(2, p);
+  mrb_value ary = cpp_to_mrb_value(mrb, points);
+  assert(RARRAY_LEN(ary) == 2);
+  auto points_back = mrb_value_to_cpp<std::vector<DescribedPoint>>(mrb, ary);
+  assert(points_back.size() == 2 && points_back[1].label == "origin");
+}
+
+static void run_arena_tests(mrb_state* mrb) {
+  std::vector<std::map<std::string, std::vector<std::string>>> wide(200, {{"k", std::vector<std::string>(50, "v")}});
+
+  int before = mrb_gc_arena_save(mrb);
+  mrb_value v = cpp_to_mrb_value(mrb, wide);
+  // only the root stays protected
+  assert(mrb_gc_arena_save(mrb) == before + 1);
+  assert(RARRAY_LEN(v) == 200);
+  mrb_gc_arena_restore(mrb, before);
+
+#ifdef MRB_DEBUG
+  mrb_converter_context* ctx = mrb_converter_context_get(mrb);
+  ctx->arena_high_water = 0;
+  cpp_to_mrb_value(mrb, wide);
+  // root, map, key and vector plus its current element, independent of the width
+  assert(ctx->arena_high_water <= before + 8);
+  mrb_gc_arena_restore(mrb, before);
+#endif
+}
+
+static void run_key_table_tests(mrb_state* mrb) {
+  std::vector<std::map<std::string, int>> rows(3, {{"id", 1}, {"name", 2}});
+
+  mrb_key_table keys(mrb);
+  mrb_value ary = cpp_to_mrb_value(mrb, rows, keys);
+  mrb_value first = mrb_hash_keys(mrb, RARRAY_PTR(ary)[0]);
+  mrb_value last = mrb_hash_keys(mrb, RARRAY_PTR(ary)[2]);
+  // every row shares the same frozen key Strings
+  assert(mrb_obj_eq(mrb, RARRAY_PTR(first)[0], RARRAY_PTR(last)[0]));
+  assert(mrb_frozen_p(mrb_basic_ptr(RARRAY_PTR(first)[0])));
+  assert(keys.size() == 2);
+
+  // the table outlives the call
+  mrb_value again = cpp_to_mrb_value(mrb, rows[0], keys);
+  assert(mrb_obj_eq(mrb, RARRAY_PTR(mrb_hash_keys(mrb, again))[0], RARRAY_PTR(first)[0]));
+
+  // a conversion which raises half way leaves nothing behind for later ones
+  if constexpr (std::numeric_limits<long double>::max() > std::numeric_limits<mrb_float>::max()) {
+    mrb_bool error;
+    mrb_protect_error(mrb, [](mrb_state* mrb, void* ud) -> mrb_value {
+      std::map<std::string, long double> huge{{"id", std::numeric_limits<long double>::max()}};
+      return cpp_to_mrb_value(mrb, huge, *static_cast<mrb_key_table*>(ud));
+    }, &keys, &error);
+    assert(error);
+  }
+  mrb_value unkeyed = cpp_to_mrb_value(mrb, rows[0]);
+  assert(!mrb_obj_eq(mrb, RARRAY_PTR(mrb_hash_keys(mrb, unkeyed))[0], RARRAY_PTR(first)[0]));
+
+  mrb_key_table syms(mrb, mrb_key_mode::symbols);
+  mrb_value h = cpp_to_mrb_value(mrb, rows[0], syms);
+  assert(mrb_integer(mrb_hash_get(mrb, h, mrb_symbol_value(mrb_intern_lit(mrb, "id")))) == 1);
+
+  // without a table keys stay plain Strings
+  mrb_value plain = cpp_to_mrb_value(mrb, rows[0]);
+  assert(mrb_string_p(RARRAY_PTR(mrb_hash_keys(mrb, plain))[0]));
+}
+
+static void run_converter_context_tests(mrb_state* mrb) {
+  mrb_converter_context* ctx = mrb_converter_context_get(mrb);
+  assert(ctx == mrb_converter_context_get(mrb));
+  struct RClass* time_class = mrb_class_get_id(mrb, MRB_SYM(Time));
+  assert(mrb_converter_time_class(mrb) == time_class);
+  assert(ctx->time_class == time_class);
+
+  mrb_converter_context_invalidate(mrb);
+  assert(ctx->time_class == nullptr);
+  assert(mrb_converter_time_class(mrb) == time_class);
+
+  std::vector<std::chrono::system_clock::time_point> stamps(3, std::chrono::system_clock::now());
+  mrb_value ary = cpp_to_mrb_value(mrb, stamps);
+  assert(RARRAY_LEN(ary) == 3 && mrb_obj_is_kind_of(mrb, RARRAY_PTR(ary)[2], time_class));
+}
+
 // -------------------------------------------------------------
 // Test: mrb_cpp_new + mrb_cpp_get round‑trip
 // -------------------------------------------------------------
@@ -327,12 +778,258 @@ static void run_cpp_data_roundtrip_test(mrb_state* mrb) {
 }
 
 
+struct PooledThing {
+  int64_t id;
+  explicit PooledThing(int64_t i) : id(i) {}
+  virtual ~PooledThing() = default;
+};
+
+struct BigPooledThing : PooledThing {
+  char payload[64] = {};
+  using PooledThing::PooledThing;
+};
+
+MRB_CPP_DEFINE_POOLED_TYPE(PooledThing, pooledthing)
+
+static void run_cpp_pool_test(mrb_state* mrb) {
+  struct RClass* cls = mrb_define_class(mrb, "PooledThingHolder", mrb->object_class);
+  MRB_SET_INSTANCE_TT(cls, MRB_TT_DATA);
+  const mrb_data_type* dt = mrb_data_type_traits<PooledThing>::get();
+
+  int arena_index = mrb_gc_arena_save(mrb);
+  for (int i = 0; i < 100; ++i) {
+    mrb_value obj = mrb_obj_new(mrb, cls, 0, nullptr);
+    mrb_cpp_new<PooledThing>(mrb, obj, i);
+    assert(mrb_cpp_get<PooledThing>(mrb, obj)->id == i);
+    mrb_gc_arena_restore(mrb, arena_index);
+  }
+
+  mrb_cpp_pool_stats stats;
+  assert(mrb_cpp_pool_stats_get(mrb, dt, &stats));
+  assert(stats.allocations == 100 && stats.capacity >= 100);
+
+  mrb_full_gc(mrb);
+  mrb_value obj = mrb_obj_new(mrb, cls, 0, nullptr);
+  mrb_cpp_new<PooledThing>(mrb, obj, 7);
+  mrb_cpp_pool_stats_get(mrb, dt, &stats);
+  // the freed slots are handed out again
+  assert(stats.recycled >= 1);
+  assert(stats.live < 100);
+
+  // subclasses still resolve to the base type, the bigger ones bypass the pool
+  mrb_value big = mrb_obj_new(mrb, cls, 0, nullptr);
+  mrb_cpp_new<BigPooledThing>(mrb, big, 8);
+  assert(mrb_cpp_get<BigPooledThing>(mrb, big)->id == 8);
+  assert(mrb_cpp_get<PooledThing>(mrb, big)->id == 8);
+  mrb_cpp_pool_stats_get(mrb, dt, &stats);
+  assert(stats.fallbacks == 1);
+  mrb_gc_arena_restore(mrb, arena_index);
+}
+
+struct InlineVec2 {
+  double x, y;
+  InlineVec2(double a, double b) : x(a), y(b) {}
+};
+
+struct InlineId {
+  uint64_t id;
+  explicit InlineId(uint64_t i) : id(i) {}
+};
+
+MRB_CPP_DEFINE_INLINE_TYPE(InlineVec2, inlinevec2)
+MRB_CPP_DEFINE_INLINE_TYPE(InlineId, inlineid)
+
+static void run_cpp_inline_test(mrb_state* mrb) {
+#ifdef MRB_CPP_HAVE_INLINE_STORAGE
+  static_assert(mrb_cpp_storage_of<InlineVec2>::value == mrb_cpp_storage::inline_data);
+#endif
+  struct RClass* cls = mrb_define_class(mrb, "InlineVec2Holder", mrb->object_class);
+  MRB_SET_INSTANCE_TT(cls, mrb_cpp_instance_tt<InlineVec2>());
+
+  mrb_value obj = mrb_obj_new(mrb, cls, 0, nullptr);
+  assert(mrb_cpp_get<InlineVec2>(mrb, obj) == nullptr);
+  mrb_cpp_new<InlineVec2>(mrb, obj, 1.5, -2.0);
+  InlineVec2* v = mrb_cpp_get<InlineVec2>(mrb, obj);
+  assert(v && v->x == 1.5 && v->y == -2.0);
+  // another inline type doesn't match the tag
+  assert(mrb_cpp_get<InlineId>(mrb, obj) == nullptr);
+
+  // dup copies the inline bytes
+  mrb_value copy = mrb_obj_dup(mrb, obj);
+  v->x = 3.0;
+  assert(mrb_cpp_get<InlineVec2>(mrb, copy)->x == 1.5);
+
+#ifdef MRB_CPP_HAVE_INLINE_STORAGE
+  // inline instances have no instance variables, neither in subclasses
+  mrb_value r = mrb_load_string(mrb,
+    "class TaggedVec2 < InlineVec2Holder; def tag!; @tag = 1; end; end;"
+    "begin; TaggedVec2.new.tag!; rescue ArgumentError; :raised; end");
+  assert(mrb_symbol_p(r));
+#endif
+}
+
+struct BoundCounter {
+  int64_t count = 0;
+  std::string label;
+
+  int64_t add(int64_t n) { return count += n; }
+  const std::string& name() const { return label; }
+  void rename(std::string l) { label = std::move(l); }
+  void relabel(std::string l, int64_t n) { label = std::move(l); count = n; }
+  BoundCounter& reset() noexcept { count = 0; return *this; }
+  std::vector<int64_t> repeat(int64_t times) const { return std::vector<int64_t>(times, count); }
+};
+
+MRB_CPP_DEFINE_TYPE(BoundCounter, boundcounter)
+
+static void run_cpp_method_test(mrb_state* mrb) {
+  struct RClass* cls = mrb_define_class(mrb, "BoundCounter", mrb->object_class);
+  MRB_SET_INSTANCE_TT(cls, MRB_TT_DATA);
+  mrb_define_method(mrb, cls, "initialize", [](mrb_state* mrb, mrb_value self) -> mrb_value {
+    mrb_cpp_new<BoundCounter>(mrb, self);
+    return self;
+  }, MRB_ARGS_NONE());
+  mrb_cpp_define_method<&BoundCounter::add>(mrb, cls, "add");
+  mrb_cpp_define_method<&BoundCounter::name>(mrb, cls, "name");
+  mrb_cpp_define_method<&BoundCounter::rename>(mrb, cls, "rename");
+  mrb_cpp_define_method<&BoundCounter::reset>(mrb, cls, "reset");
+  mrb_cpp_define_method<&BoundCounter::repeat>(mrb, cls, "repeat");
+  mrb_cpp_define_method<&BoundCounter::relabel>(mrb, cls, "relabel");
+
+  // only calls with something to destroy pay for mrb_protect_error
+  static_assert(mrbcpp::method::call_state<&BoundCounter::add>::trivial);
+  static_assert(mrbcpp::method::call_state<&BoundCounter::reset>::trivial);
+  static_assert(!mrbcpp::method::call_state<&BoundCounter::relabel>::trivial);
+  static_assert(!mrbcpp::method::call_state<&BoundCounter::repeat>::trivial);
+
+  mrb_value r = mrb_load_string(mrb, "c = BoundCounter.new; c.add(2); c.add(3)");
+  assert(mrb_integer(r) == 5);
+  r = mrb_load_string(mrb, "c = BoundCounter.new; c.rename('hits'); c.name");
+  assert(mrb_str_view(mrb, r) == "hits");
+  r = mrb_load_string(mrb, "c = BoundCounter.new; c.add(4); c.repeat(2)");
+  assert(RARRAY_LEN(r) == 2 && mrb_integer(RARRAY_PTR(r)[1]) == 4);
+  r = mrb_load_string(mrb, "c = BoundCounter.new; c.add(4); c.reset.equal?(c) && c.add(0) == 0");
+  assert(mrb_true_p(r));
+
+  r = mrb_load_string(mrb, "begin; BoundCounter.new.add('x'); rescue TypeError; :raised; end");
+  assert(mrb_symbol_p(r));
+  r = mrb_load_string(mrb, "begin; BoundCounter.new.add; rescue ArgumentError; :raised; end");
+  assert(mrb_symbol_p(r));
+  // the first argument is converted already when the second one fails
+  r = mrb_load_string(mrb, "c = BoundCounter.new; begin; c.relabel('l' * 100, 'x'); rescue TypeError; c.name.empty?; end");
+  assert(mrb_true_p(r));
+  r = mrb_load_string(mrb, "c = BoundCounter.new; c.relabel('l' * 100, 3); c.name.size + c.add(0)");
+  assert(mrb_integer(r) == 103);
+}
+
+struct CountedBuffer {
+  std::vector<char> bytes;
+  explicit CountedBuffer(size_t n) : bytes(n) {}
+};
+
+template <>
+struct mrb_cpp_size<CountedBuffer> {
+  static size_t of(const CountedBuffer& b) { return sizeof(b) + b.bytes.capacity(); }
+};
+
+MRB_CPP_DEFINE_TYPE(CountedBuffer, countedbuffer)
+
+struct WideCountedBuffer : CountedBuffer {
+  char extra[512] = {};
+  WideCountedBuffer() : CountedBuffer(0) {}
+};
+
+static void run_cpp_object_stats_test(mrb_state* mrb) {
+#ifdef MRB_CPP_OBJECT_STATS
+  struct RClass* cls = mrb_define_class(mrb, "CountedBufferHolder", mrb->object_class);
+  MRB_SET_INSTANCE_TT(cls, MRB_TT_DATA);
+  const mrb_data_type* dt = mrb_data_type_traits<CountedBuffer>::get();
+
+  int arena_index = mrb_gc_arena_save(mrb);
+  mrb_value keep = mrb_obj_new(mrb, cls, 0, nullptr);
+  mrb_cpp_new<CountedBuffer>(mrb, keep, 1000);
+  for (int i = 0; i < 10; ++i) {
+    mrb_value obj = mrb_obj_new(mrb, cls, 0, nullptr);
+    mrb_cpp_new<CountedBuffer>(mrb, obj, 10);
+    mrb_gc_arena_restore(mrb, arena_index + 1);
+  }
+
+  mrb_full_gc(mrb);
+
+  mrb_cpp_object_stats stats;
+  assert(mrb_cpp_object_stats_get(mrb, dt, &stats));
+  assert(stats.allocated == 11 && stats.live == 1 && stats.freed == 10);
+  assert(stats.bytes >= 1000 + sizeof(CountedBuffer));
+
+  // a subclass shares the data type but reports its own size
+  mrb_value wide = mrb_obj_new(mrb, cls, 0, nullptr);
+  mrb_cpp_new<WideCountedBuffer>(mrb, wide);
+  size_t before = stats.bytes;
+  assert(mrb_cpp_object_stats_get(mrb, dt, &stats));
+  assert(stats.live == 2 && stats.bytes == before + sizeof(WideCountedBuffer));
+
+  mrb_value rb = mrb_load_string(mrb, "CExtHelpers.object_stats['CountedBuffer'][:live]");
+  assert(mrb_integer(rb) == 2);
+
+  // fixed size objects are only counted, without a per object entry
+  static_assert(!mrb_data_type_traits<BoundCounter>::sized_per_object);
+  static_assert(mrb_data_type_traits<CountedBuffer>::sized_per_object);
+  static_assert(mrb_data_type_traits<WideCountedBuffer>::sized_per_object);
+  const mrb_data_type* bound = mrb_data_type_traits<BoundCounter>::get();
+  mrb_load_string(mrb, "$counters = Array.new(3) { BoundCounter.new }");
+  assert(mrb_cpp_object_stats_get(mrb, bound, &stats));
+  size_t live_before = stats.live;
+  assert(stats.bytes == stats.live * sizeof(BoundCounter));
+  assert(mrb_converter_context_get(mrb)->object_stats[bound].sized.empty());
+  mrb_load_string(mrb, "$counters = nil");
+  mrb_full_gc(mrb);
+  assert(mrb_cpp_object_stats_get(mrb, bound, &stats));
+  assert(stats.live + 3 <= live_before && stats.bytes == stats.live * sizeof(BoundCounter));
+  mrb_gc_arena_restore(mrb, arena_index);
+#endif
+}
+
+static void run_conversion_stats_test(mrb_state* mrb) {
+#ifdef MRB_CONVERSION_STATS
+  mrb_converter_context* ctx = mrb_converter_context_get(mrb);
+  for (mrb_conversion_counter& counter : ctx->conversion_stats) counter = mrb_conversion_counter();
+  const mrb_conversion_counter* c = ctx->conversion_stats;
+
+  int arena_index = mrb_gc_arena_save(mrb);
+  std::vector<std::string> words(10000, "abc");
+  mrb_value ary = cpp_to_mrb_value(mrb, words);
+  assert(c[MRB_CONV_CPP_TO_MRB].calls == 1 && c[MRB_CONV_CPP_TO_MRB].nanoseconds > 0);
+  assert(c[MRB_CONV_ARRAY].calls == 1 && c[MRB_CONV_ARRAY].elements == 10000);
+  assert(c[MRB_CONV_STRING].calls == 10000 && c[MRB_CONV_STRING].bytes == 30000);
+
+  mrb_value_to_any(mrb, ary);
+  assert(c[MRB_CONV_TO_ANY].calls == 1 && c[MRB_CONV_TO_ANY].elements == 10001);
+  assert(c[MRB_CONV_TO_ANY].bytes == 30000);
+
+  mrb_value rb = mrb_load_string(mrb, "CExtHelpers::Stats.to_h[:string][:calls]");
+  assert(mrb_integer(rb) == 10000);
+  mrb_gc_arena_restore(mrb, arena_index);
+#endif
+}
+
 MRB_BEGIN_DECL
 void mrb_mruby_c_ext_helpers_gem_test(mrb_state* mrb) {
     run_value_to_cpp_tests(mrb);
+    run_typed_value_to_cpp_tests(mrb);
+    run_string_view_tests(mrb);
+    run_visitor_tests(mrb);
+    run_converter_context_tests(mrb);
+    run_describe_tests(mrb);
+    run_arena_tests(mrb);
+    run_key_table_tests(mrb);
     run_cpp_to_mrb_tests(mrb);
     test_edges(mrb);
     run_cpp_data_roundtrip_test(mrb);
+    run_cpp_pool_test(mrb);
+    run_cpp_inline_test(mrb);
+    run_cpp_method_test(mrb);
+    run_cpp_object_stats_test(mrb);
+    run_conversion_stats_test(mrb);
     run_subclassing_tests(mrb);
 }
 MRB_END_DECL
@@ -9,3 +9,135 @@ end
 assert("Big Endian Fixnum de-/encoding") do
   assert_equal(100, 100.to_bin_be.to_fix_be)
 end
+
+assert("Packed number de-/encoding") do
+  assert_equal("\x01\x00\x02\x00", [1, 2].to_bin_le(:u16))
+  assert_equal("\x00\x01\x00\x02", [1, 2].to_bin_be(:i16))
+  assert_equal([1, -2, 3], [1, -2, 3].to_bin_le(:i32).unpack_le(:i32))
+  assert_equal([1, -2, 3], [1, -2, 3].to_bin_be(:i64).unpack_be(:i64))
+  assert_equal([255, 0], "\xff\x00".unpack_le(:u8))
+  assert_equal([1.5, -0.25], [1.5, -0.25].to_bin_be(:f64).unpack_be(:f64))
+  assert_equal([0.5], [0.5].to_bin_le(:f32).unpack_le(:f32))
+  assert_raise(RangeError) { [256].to_bin_le(:u8) }
+  assert_raise(ArgumentError) { "\x00\x00\x00".unpack_le(:u16) }
+  assert_raise(ArgumentError) { [1].to_bin_le(:i7) }
+end
+
+assert("String#bswap!") do
+  s = [1, 2, 3].to_bin_le(:u32)
+  assert_equal(s.object_id, s.bswap!(4).object_id)
+  assert_equal([1, 2, 3], s.unpack_be(:u32))
+  assert_raise(ArgumentError) { "abc".bswap!(2) }
+  assert_raise(ArgumentError) { "abcdef".bswap!(3) }
+  assert_equal((1..16).to_a.reverse, (1..16).to_a.to_bin_le(:u8).bswap!(16).unpack_le(:u8))
+end
+
+assert("Varint de-/encoding") do
+  assert_equal("\x00", 0.to_varint)
+  assert_equal("\x96\x01", 150.to_varint)
+  assert_equal("\x01", -1.to_zigzag)
+  assert_equal("\x04", 2.to_zigzag)
+  bin = [1, 300, 2**40].map(&:to_varint).join
+  assert_equal([1, 300, 2**40], bin.unpack_varints)
+  zz = [-1, 0, 5, -2**40].map(&:to_zigzag).join
+  assert_equal([-1, 0, 5, -2**40], zz.unpack_varints(true))
+  seen = []
+  assert_equal(bin, bin.each_varint { |i| seen << i })
+  assert_equal([1, 300, 2**40], seen)
+  assert_raise(ArgumentError) { "\x80".unpack_varints }
+end
+
+assert("Fixed width de-/encoding") do
+  assert_equal("\x00\x00\x01\x00", 256.to_bin(4, :be))
+  assert_equal("\x00\x01\x00\x00", 256.to_bin(4, :le))
+  assert_equal("\xff\xfe", -2.to_bin(2, :be))
+  assert_equal(1, "\x01\x00".to_num(:u16, :le))
+  assert_equal(-2, "\xff\xfe".to_num(:i16, :be))
+  assert_equal(0xdeadbeef, 0xdeadbeef.to_bin(4, :be).to_num(:u32, :be))
+  assert_equal(1.5, 1.5.to_bin(4, :be).to_num(:f32, :be))
+  assert_equal(-7, -7.to_bin(16, :le).to_num(:i128, :le))
+  if (2**100).is_a?(Integer)
+    assert_equal(-(2**100), (-(2**100)).to_bin(16, :le).to_num(:i128, :le))
+    assert_equal(2**100, (2**100).to_bin(16, :be).to_num(:u128, :be))
+  end
+  assert_raise(RangeError) { 256.to_bin(1) }
+  assert_raise(ArgumentError) { 1.to_bin(3) }
+  assert_raise(ArgumentError) { "\x01".to_num(:u16) }
+end
+
+assert("CExtHelpers::BinaryReader") do
+  bin = "\x01" + 258.to_bin(2, :be) + 7.to_bin(4, :le) + -3.to_bin(8, :be) + 1.5.to_bin(8, :le) + 300.to_varint + "tail"
+  r = CExtHelpers::BinaryReader.new(bin)
+  assert_equal(1, r.read_u8)
+  assert_equal(258, r.read_u16_be)
+  assert_equal(7, r.read_u32_le)
+  assert_equal(-3, r.read_i64_be)
+  assert_equal(1.5, r.read_f64_le)
+  assert_equal(300, r.read_varint)
+  assert_equal(4, r.remaining)
+  assert_equal("ta", r.read_bytes(2))
+  r.skip(1)
+  assert_false(r.eof?)
+  assert_raise(RangeError) { r.read_u16_le }
+  assert_equal("l", r.read_bytes(1))
+  assert_true(r.eof?)
+  assert_raise(RangeError) { r.read_varint }
+  r.pos = 1
+  assert_equal(258, r.read_u16_be)
+  assert_raise(RangeError) { CExtHelpers::BinaryReader.new("\x80\x80").read_varint }
+  assert_raise(ArgumentError) { CExtHelpers::BinaryReader.new("\xff" * 11).read_varint }
+end
+
+assert("CExtHelpers::BinaryWriter") do
+  w = CExtHelpers::BinaryWriter.new(32)
+  assert_equal(w, w.write_u8(1).write_u16_be(258).write_i32_le(-7))
+  w.write_f64_be(1.5).write_varint(300).write_varint(-2, true).write_bytes("ab")
+  assert_equal(20, w.size)
+  bin = w.to_s
+  assert_equal(0, w.size)
+  r = CExtHelpers::BinaryReader.new(bin)
+  assert_equal(1, r.read_u8)
+  assert_equal(258, r.read_u16_be)
+  assert_equal(-7, r.read_i32_le)
+  assert_equal(1.5, r.read_f64_be)
+  assert_equal(300, r.read_varint)
+  assert_equal(-2, r.read_varint(true))
+  assert_equal("ab", r.read_bytes(2))
+  assert_raise(RangeError) { w.write_u8(256) }
+  assert_raise(RangeError) { w.write_u32_le(-1) }
+  assert_equal(-1.to_varint, CExtHelpers::BinaryWriter.new.write_varint(-1).to_s)
+  assert_equal(10, -1.to_varint.bytesize)
+end
+
+assert("String#incr! and String#decr!") do
+  nonce = "\x00" * 11 + "\xff"
+  assert_equal(nonce.object_id, nonce.incr!.object_id)
+  assert_equal("\x00" * 10 + "\x01\x00", nonce)
+  nonce.decr!
+  assert_equal("\x00" * 11 + "\xff", nonce)
+  le = "\xff" * 9 + "\x00" * 15
+  le.incr!(1, endian: :le)
+  assert_equal("\x00" * 9 + "\x01" + "\x00" * 14, le)
+  assert_equal("\x01\x2c", "\x00\x00".incr!(300))
+  assert_equal("\x00\x01", "\x01\x2c".incr!(-299))
+  max = "\xff" * 12
+  assert_raise(RangeError) { max.incr! }
+  assert_equal("\xff" * 12, max)
+  assert_equal("\x00" * 12, max.incr!(wrap: true))
+  assert_raise(RangeError) { "\x00\x00".decr! }
+end
+
+assert("CExtHelpers::Stats") do
+  CExtHelpers::Stats.reset
+  1.to_bin
+  "\x01\x00".to_num(:u16, :le)
+  stats = CExtHelpers::Stats.to_h
+  if CExtHelpers::Stats.enabled?
+    assert_equal(1, stats[:encode][:calls])
+    assert_equal(2, stats[:decode][:bytes])
+  else
+    assert_equal(0, stats[:encode][:calls])
+  end
+  CExtHelpers::Stats.reset
+  assert_equal(0, CExtHelpers::Stats.to_h[:decode][:calls])
+end